@@ -0,0 +1,65 @@
+#include "arena.h"
+#include <new>
+
+namespace {
+	void* allocate(size_t bytes) {
+		return ::operator new(bytes, std::align_val_t(Arena::alignment));
+	}
+
+	void deallocate(void* p) {
+		::operator delete(p, std::align_val_t(Arena::alignment));
+	}
+}
+
+Arena::~Arena() {
+	trim();
+}
+
+void* Arena::acquire(size_t bytes, size_t& capacity) {
+	// smallest cached block that fits
+	size_t best = cached.size();
+	for (size_t i = 0; i < cached.size(); i++) {
+		if (cached[i].capacity >= bytes
+			&& (best == cached.size() || cached[i].capacity < cached[best].capacity))
+		{
+			best = i;
+		}
+	}
+	if (best != cached.size()) {
+		Block b = cached[best];
+		cached.erase(cached.begin() + best);
+		capacity = b.capacity;
+		return b.ptr;
+	}
+
+	capacity = (bytes + alignment - 1) / alignment * alignment;
+	return allocate(capacity);
+}
+
+void Arena::release(void* block, size_t capacity) {
+	if (!block) return;
+
+	cached.push_back(Block{ block, capacity });
+	if (cached.size() > maxCached) {
+		// drop the smallest, large canvases are the expensive ones to recreate
+		size_t smallest = 0;
+		for (size_t i = 1; i < cached.size(); i++) {
+			if (cached[i].capacity < cached[smallest].capacity) smallest = i;
+		}
+		deallocate(cached[smallest].ptr);
+		cached.erase(cached.begin() + smallest);
+	}
+}
+
+void Arena::trim() {
+	for (auto& b : cached) {
+		deallocate(b.ptr);
+	}
+	cached.clear();
+}
+
+Arena& Arena::shared() {
+	// never destroyed, images in other static objects release into it at exit
+	static Arena* arena = new Arena();
+	return *arena;
+}
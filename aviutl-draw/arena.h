@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+// Keeps released 64-byte aligned blocks and hands them out again, so
+// canvases that are resized or recreated every frame reuse their memory.
+class Arena {
+public:
+	static constexpr size_t alignment = 64;
+
+	Arena() = default;
+	~Arena();
+
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	// returns a block of at least bytes and stores its real size in capacity
+	void* acquire(size_t bytes, size_t& capacity);
+	void release(void* block, size_t capacity);
+
+	// frees every cached block
+	void trim();
+
+	static Arena& shared();
+
+private:
+	struct Block {
+		void* ptr;
+		size_t capacity;
+	};
+
+	static constexpr size_t maxCached = 8;
+	std::vector<Block> cached;
+};
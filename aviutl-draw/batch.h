@@ -0,0 +1,321 @@
+#pragma once
+
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "render.h"
+#include "mipmap.h"
+#include "profile.h"
+
+namespace batch
+{
+	// one draw() or drawPerspective() call, which can be replayed clipped to
+	// any part of dest
+	struct Command {
+		ReadOnlyImage src;
+		render::Pipeline pipeline;
+		Mat<Number> inv; // destination to source
+		Vec2<Number> quad[4];
+		Rect bounds;
+		bool perspective;
+		profile::Function function = profile::draw; // counted under while profiling
+
+		// set when minifying with a pyramid: the two levels around the
+		// scale, from level firstLevel, mixed by levelWeight / 256
+		std::shared_ptr<const mipmap::Pyramid> pyramid;
+		ReadOnlyImage levels[2];
+		Mat<Number> levelInv[2];
+		int levelWeight = 0;
+		int firstLevel = 0;
+
+		// set for bicubic and Lanczos draws without rotation, with the taps
+		// of the columns and rows of bounds
+		const resample::Kernel* separable = nullptr;
+		std::vector<resample::Taps> columnTaps;
+		std::vector<resample::Taps> rowTaps;
+
+		// set by antialias(): the edges of the source in dest
+		raster::Coverage edges;
+		bool antialiased = false;
+
+		// source texels per destination pixel when every pixel falls on a
+		// texel (integer offsets, zoom 1 / step), otherwise 0
+		int alignedStep = 0;
+		Vec2<int> alignedOffset{};
+		bool nearest = false;
+
+		// src centered on dest, moved by ox,oy and zoomed and rotated
+		// (radians) around its center, as draw() places it. pyramidOf
+		// returns the mip pyramid of src, or is null when not filtering with
+		// one; it is called only when the draw minifies and covers pixels.
+		Command(
+			const Image& dest, const ReadOnlyImage& src, const render::Pipeline& pipeline, int interpolateMode,
+			int ox, int oy, Number zoom, Number rotate,
+			const std::function<std::shared_ptr<const mipmap::Pyramid>()>& pyramidOf = nullptr)
+			: src(src), pipeline(pipeline), perspective(false)
+		{
+			Mat<Number> mat;
+			mat.translate(-src.width * 0.5, -src.height * 0.5);
+			mat.scale(zoom, zoom);
+			mat.rotate(rotate);
+			mat.translate(dest.width * 0.5 + ox, dest.height * 0.5 + oy);
+			inv = mat.inverse();
+
+			interpolate::footprint(interpolateMode, src, quad);
+			const bool mip = pyramidOf && selectLevels();
+			if ((interpolateMode == interpolate::bicubicMode || interpolateMode == interpolate::lanczos3Mode)
+				&& inv.m12 == 0 && inv.m21 == 0 && inv.m11 > 0 && inv.m22 > 0)
+			{
+				separable = &resample::kernel(interpolateMode);
+			}
+			if (!mip) {
+				selectAligned(interpolateMode);
+			}
+			for (auto& p : quad) {
+				p = mat.transform(p);
+			}
+			bounds = raster::bounds(quad, 4, Rect(0, 0, dest.width, dest.height));
+			if (mip && !bounds.empty()) {
+				bindLevels(pyramidOf());
+			}
+			if (separable) {
+				columnTaps = resample::axisTaps(*separable, inv.m11, inv.m13, src.width, bounds.left, bounds.right);
+				rowTaps = resample::axisTaps(*separable, inv.m22, inv.m23, src.height, bounds.top, bounds.bottom);
+			}
+		}
+
+		// src mapped onto the destination quad xy by the perspective matrix mat
+		Command(
+			const Image& dest, const ReadOnlyImage& src, const render::Pipeline& pipeline,
+			const Mat<Number>& mat, const Vec2<Number> xy[4])
+			: src(src), pipeline(pipeline), inv(mat), quad{ xy[0], xy[1], xy[2], xy[3] }, perspective(true)
+		{
+			bounds = raster::bounds(quad, 4, Rect(0, 0, dest.width, dest.height));
+		}
+
+		// fades the pixels the edges of the source cross by how much of them
+		// it covers, instead of drawing the ones whose center is inside and
+		// letting the samplers fade past the edges.
+		// The edges are those of the texels, half a texel outside the
+		// centers, or the quad of drawPerspective(). Concave and degenerate
+		// quads stay aliased, and so do draws aligned to the pixels at zoom
+		// 1, whose edges fall between pixels.
+		void antialias(const Image& dest) {
+			if (alignedStep == 1) return;
+
+			Vec2<Number> corners[4];
+			if (perspective) {
+				std::copy(quad, quad + 4, corners);
+			}
+			else {
+				const Mat<Number> mat = inv.inverse();
+				const Number w = src.width - 0.5, h = src.height - 0.5;
+				corners[0] = mat.transform(Vec2<Number>{ -0.5, -0.5 });
+				corners[1] = mat.transform(Vec2<Number>{ w, -0.5 });
+				corners[2] = mat.transform(Vec2<Number>{ w, h });
+				corners[3] = mat.transform(Vec2<Number>{ -0.5, h });
+			}
+			if (!edges.init(corners, 4)) return;
+
+			edges.outline(quad);
+			bounds = raster::bounds(quad, 4, Rect(0, 0, dest.width, dest.height));
+			// the separable filter can't keep its taps on the texels
+			alignedStep = 0;
+			separable = nullptr;
+			columnTaps.clear();
+			rowTaps.clear();
+			antialiased = true;
+		}
+
+		// points the command at a copy of its source
+		void setSource(const ReadOnlyImage& copy) {
+			for (auto& level : levels) {
+				if (level.data == src.data) level = copy;
+			}
+			src = copy;
+		}
+
+		void draw(Image& dest, const Rect& clip) const {
+			Rect r(
+				std::max(clip.left, bounds.left), std::max(clip.top, bounds.top),
+				std::min(clip.right, bounds.right), std::min(clip.bottom, bounds.bottom));
+			if (r.empty()) return;
+			if (profile::enabled()) {
+				drawProfiled(dest, r);
+			}
+			else {
+				drawClipped(dest, pipeline, r);
+			}
+		}
+
+	private:
+		void drawClipped(Image& dest, const render::Pipeline& p, const Rect& r) const {
+			if (!antialiased) {
+				drawPath(dest, p, r);
+				return;
+			}
+			render::Pipeline faded = p;
+			faded.coverage = &edges;
+			drawPath(dest, faded, r);
+		}
+
+		void drawPath(Image& dest, const render::Pipeline& p, const Rect& r) const {
+			if (!p.readsSource) {
+				render::drawFootprint(dest, p, quad, r);
+			}
+			else if (perspective) {
+				render::drawPerspective(dest, src, p, inv, quad, r);
+			}
+			else if (alignedStep) {
+				render::drawAligned(dest, src, p, alignedStep, alignedOffset, nearest, quad, r);
+			}
+			else if (separable) {
+				render::drawSeparable(
+					dest, src, p, *separable, columnTaps.data(), bounds.left, rowTaps.data(), bounds.top, quad, r);
+			}
+			else if (!pyramid) {
+				render::drawAffine(dest, src, p, inv, quad, r);
+			}
+			else if (levelWeight == 0) {
+				render::drawAffine(dest, levels[0], p, levelInv[0], quad, r);
+			}
+			else {
+				render::drawAffineMip(dest, levels, p, levelInv, levelWeight, quad, r);
+			}
+		}
+
+		// the blend span of the pipeline drawing on this thread, and what it did
+		struct Blended {
+			render::BlendSpan span;
+			int64_t pixels;
+			int64_t nanoseconds;
+		};
+		static inline thread_local Blended blended{};
+
+		static void timedBlend(BGRA* dest, const BGRA* src, int n, const render::AlphaTable& alpha) {
+			const int64_t t0 = profile::now();
+			blended.span(dest, src, n, alpha);
+			blended.nanoseconds += profile::now() - t0;
+			blended.pixels += n;
+		}
+
+		// drawClipped() through timedBlend; the rest of the time is sampling
+		void drawProfiled(Image& dest, const Rect& r) const {
+			render::Pipeline timed = pipeline;
+			timed.blend = timedBlend;
+			blended = Blended{ pipeline.blend, 0, 0 };
+
+			const int64_t t0 = profile::now();
+			drawClipped(dest, timed, r);
+			const int64_t total = profile::now() - t0;
+
+			auto& c = profile::counters[function];
+			profile::add(c.visited, static_cast<int64_t>(r.right - r.left) * (r.bottom - r.top));
+			profile::add(c.covered, blended.pixels);
+			profile::add(c.nanoseconds[profile::blend], blended.nanoseconds);
+			profile::add(c.nanoseconds[profile::sample], total - blended.nanoseconds);
+		}
+
+		void selectAligned(int interpolateMode) {
+			auto isInteger = [](Number v, Number limit) {
+				return v == std::floor(v) && std::abs(v) <= limit;
+			};
+			if (inv.m12 == 0 && inv.m21 == 0 && inv.m11 == inv.m22 && inv.m11 >= 1
+				&& isInteger(inv.m11, 1 << 10) && isInteger(inv.m13, 1 << 20) && isInteger(inv.m23, 1 << 20))
+			{
+				alignedStep = static_cast<int>(inv.m11);
+				alignedOffset = Vec2<int>{ static_cast<int>(inv.m13), static_cast<int>(inv.m23) };
+				nearest = interpolateMode == 0;
+			}
+		}
+
+		// picks the levels from the number of source texels per destination
+		// pixel and grows quad to the footprint of the coarser one, from the
+		// size of src alone; false when the draw doesn't minify
+		bool selectLevels() {
+			const Number scale = std::max(std::hypot(inv.m11, inv.m21), std::hypot(inv.m12, inv.m22));
+			const Number lod = std::log2(scale);
+			if (!(lod > 0)) return false;
+
+			const int top = mipmap::levelCount(src.width, src.height) - 1;
+			int k = std::min(static_cast<int>(lod), top);
+			int weight = k < top ? static_cast<int>((lod - k) * 256 + 0.5) : 0;
+			if (weight == 256) {
+				k++;
+				weight = 0;
+			}
+			firstLevel = k;
+			levelWeight = weight;
+
+			// bilinear footprint of the coarser level in source coordinates
+			const int coarse = std::min(k + (weight ? 1 : 0), top);
+			const Number size = std::ldexp(static_cast<Number>(1), coarse);
+			const Number lo = -0.5 * size - 0.5;
+			const Number right = (mipmap::levelSize(src.width, coarse) + 0.5) * size - 0.5;
+			const Number bottom = (mipmap::levelSize(src.height, coarse) + 0.5) * size - 0.5;
+			quad[0] = Vec2<Number>{ lo, lo };
+			quad[1] = Vec2<Number>{ right, lo };
+			quad[2] = Vec2<Number>{ right, bottom };
+			quad[3] = Vec2<Number>{ lo, bottom };
+			return true;
+		}
+
+		// samples the levels selectLevels() picked from mip
+		void bindLevels(std::shared_ptr<const mipmap::Pyramid> mip) {
+			const int top = mip->count() - 1;
+			for (int l = 0; l < 2; l++) {
+				const int level = std::min(firstLevel + l, top);
+				const Number s = std::ldexp(static_cast<Number>(1), -level);
+				levels[l] = mip->level(level);
+				levelInv[l] = inv;
+				levelInv[l].translate(0.5, 0.5);
+				levelInv[l].scale(s, s);
+				levelInv[l].translate(-0.5, -0.5);
+			}
+			pyramid = std::move(mip);
+		}
+	};
+
+	constexpr int tileSize = 64;
+
+	// Commands sorted into the destination tiles they touch. Each tile keeps
+	// submission order, so drawing the tiles in any order (or in parallel)
+	// gives the same result as drawing the commands one after another.
+	class TileBins {
+	public:
+		TileBins(const std::vector<Command>& commands, int width, int height)
+			: columns((width + tileSize - 1) / tileSize)
+			, rows((height + tileSize - 1) / tileSize)
+			, tiles(columns * rows)
+		{
+			for (int i = 0; i < static_cast<int>(commands.size()); i++) {
+				const Rect& b = commands[i].bounds;
+				if (b.empty()) continue;
+				for (int ty = b.top / tileSize; ty <= (b.bottom - 1) / tileSize; ty++) {
+					for (int tx = b.left / tileSize; tx <= (b.right - 1) / tileSize; tx++) {
+						tiles[tx + columns * ty].push_back(i);
+					}
+				}
+			}
+		}
+
+		int count() const {
+			return columns * rows;
+		}
+
+		void draw(Image& dest, const std::vector<Command>& commands, int tile) const {
+			const int x = tile % columns * tileSize;
+			const int y = tile / columns * tileSize;
+			const Rect clip(x, y, std::min(x + tileSize, dest.width), std::min(y + tileSize, dest.height));
+			for (int i : tiles[tile]) {
+				commands[i].draw(dest, clip);
+			}
+		}
+
+	private:
+		int columns;
+		int rows;
+		std::vector<std::vector<int>> tiles;
+	};
+}
@@ -2,6 +2,7 @@
 
 #include "graphic.h"
 #include <algorithm>
+#include <cstring>
 
 namespace blend
 {
@@ -13,12 +14,12 @@ namespace blend
 	using Blend = BGRA(*)(BGRA dest, BGRA src);
 
 	// ʏ
-	BGRA normal(BGRA dest, BGRA src) {
+	inline BGRA normal(BGRA dest, BGRA src) {
 		return src;
 	}
 
 	// Z
-	BGRA addition(BGRA dest, BGRA src) {
+	inline BGRA addition(BGRA dest, BGRA src) {
 		return BGRA(
 			static_cast<uint8_t>(min(dest.b + src.b, 255)),
 			static_cast<uint8_t>(min(dest.g + src.g, 255)),
@@ -27,7 +28,7 @@ namespace blend
 	}
 
 	// Z
-	BGRA subtract(BGRA dest, BGRA src) {
+	inline BGRA subtract(BGRA dest, BGRA src) {
 		return BGRA(
 			static_cast<uint8_t>(max(dest.b - src.b, 0)),
 			static_cast<uint8_t>(max(dest.g - src.g, 0)),
@@ -36,7 +37,7 @@ namespace blend
 	}
 
 	// Z
-	BGRA multiply(BGRA dest, BGRA src) {
+	inline BGRA multiply(BGRA dest, BGRA src) {
 		return BGRA(
 			static_cast<uint8_t>(dest.b * src.b / 255),
 			static_cast<uint8_t>(dest.g * src.g / 255),
@@ -45,7 +46,7 @@ namespace blend
 	}
 
 	// XN[
-	BGRA screen(BGRA dest, BGRA src) {
+	inline BGRA screen(BGRA dest, BGRA src) {
 		return BGRA(
 			static_cast<uint8_t>(dest.b + src.b - dest.b * src.b / 255),
 			static_cast<uint8_t>(dest.g + src.g - dest.g * src.g / 255),
@@ -53,7 +54,7 @@ namespace blend
 		);
 	}
 
-	uint8_t overlayElem(int a, int b) {
+	inline uint8_t overlayElem(int a, int b) {
 		if (a < 128)
 			return static_cast<uint8_t>(2 * a * b / 255);
 		else
@@ -61,7 +62,7 @@ namespace blend
 	}
 
 	// I[o[C
-	BGRA overlay(BGRA dest, BGRA src) {
+	inline BGRA overlay(BGRA dest, BGRA src) {
 		return BGRA(
 			overlayElem(dest.b, src.b),
 			overlayElem(dest.g, src.g),
@@ -70,7 +71,7 @@ namespace blend
 	}
 
 	// r()
-	BGRA lighten(BGRA dest, BGRA src) {
+	inline BGRA lighten(BGRA dest, BGRA src) {
 		return BGRA(
 			max(dest.b, src.b),
 			max(dest.g, src.g),
@@ -79,7 +80,7 @@ namespace blend
 	}
 
 	// r()
-	BGRA darken(BGRA dest, BGRA src) {
+	inline BGRA darken(BGRA dest, BGRA src) {
 		return BGRA(
 			min(dest.b, src.b),
 			min(dest.g, src.g),
@@ -88,19 +89,19 @@ namespace blend
 	}
 
 	// Px
-	BGRA luminosity(BGRA dest, BGRA src) {
+	inline BGRA luminosity(BGRA dest, BGRA src) {
 		YCbCr yd(dest), ys(src);
 		return BGRA(YCbCr(ys.y, yd.cb, yd.cr));
 	}
 
 	// F
-	BGRA color(BGRA dest, BGRA src) {
+	inline BGRA color(BGRA dest, BGRA src) {
 		YCbCr yd(dest), ys(src);
 		return BGRA(YCbCr(yd.y, ys.cb, ys.cr));
 	}
 
 	// Ae(Ă݃jA)
-	BGRA linearBurn(BGRA dest, BGRA src) {
+	inline BGRA linearBurn(BGRA dest, BGRA src) {
 		return BGRA(
 			max(dest.b + src.b - 255, 0),
 			max(dest.g + src.g - 255, 0),
@@ -109,7 +110,7 @@ namespace blend
 	}
 
 	// 
-	BGRA linearLight(BGRA dest, BGRA src) {
+	inline BGRA linearLight(BGRA dest, BGRA src) {
 		return BGRA(
 			clamp(dest.b + 2 * src.b - 255, 0, 255),
 			clamp(dest.g + 2 * src.g - 255, 0, 255),
@@ -118,7 +119,7 @@ namespace blend
 	}
 
 	// 
-	BGRA difference(BGRA dest, BGRA src) {
+	inline BGRA difference(BGRA dest, BGRA src) {
 		return BGRA(
 			abs(dest.b - src.b),
 			abs(dest.g - src.g),
@@ -127,7 +128,7 @@ namespace blend
 	}
 
 	// O
-	BGRA exclusion(BGRA dest, BGRA src) {
+	inline BGRA exclusion(BGRA dest, BGRA src) {
 		return BGRA(
 			(int)dest.b + (int)src.b - 2 * (int)dest.b * (int)src.b / 255,
 			(int)dest.g + (int)src.g - 2 * (int)dest.g * (int)src.g / 255,
@@ -136,7 +137,7 @@ namespace blend
 	}
 
 	// Z
-	BGRA divide(BGRA dest, BGRA src) {
+	inline BGRA divide(BGRA dest, BGRA src) {
 		return BGRA(
 			src.b == 0 ? 255 : min(255, 255 * (int)dest.b / (int)src.b),
 			src.g == 0 ? 255 : min(255, 255 * (int)dest.g / (int)src.g),
@@ -145,7 +146,7 @@ namespace blend
 	}
 
 	// ĂJ[
-	BGRA colorDodge(BGRA dest, BGRA src) {
+	inline BGRA colorDodge(BGRA dest, BGRA src) {
 		auto f = [](int d, int s) {
 			if (d == 0) return 0;
 			else if (s == 255) return 255;
@@ -155,7 +156,7 @@ namespace blend
 	}
 
 	// Ă݃J[
-	BGRA colorBurn(BGRA dest, BGRA src) {
+	inline BGRA colorBurn(BGRA dest, BGRA src) {
 		auto f = [](int d, int s) {
 			if (d == 255) return 255;
 			else if (s == 0) return 0;
@@ -165,7 +166,7 @@ namespace blend
 	}
 
 	// n[h~bNX
-	BGRA hardMix(BGRA dest, BGRA src) {
+	inline BGRA hardMix(BGRA dest, BGRA src) {
 		return BGRA(
 			(int)dest.b + (int)src.b >= 255 ? 255 : 0,
 			(int)dest.g + (int)src.g >= 255 ? 255 : 0,
@@ -174,7 +175,7 @@ namespace blend
 	}
 
 	// AND
-	BGRA binaryAnd(BGRA dest, BGRA src) {
+	inline BGRA binaryAnd(BGRA dest, BGRA src) {
 		return BGRA(
 			dest.b & src.b,
 			dest.g & src.b,
@@ -183,7 +184,7 @@ namespace blend
 	}
 
 	// NAND
-	BGRA binaryNand(BGRA dest, BGRA src) {
+	inline BGRA binaryNand(BGRA dest, BGRA src) {
 		return BGRA(
 			~(dest.b & src.b),
 			~(dest.g & src.b),
@@ -192,7 +193,7 @@ namespace blend
 	}
 
 	// OR
-	BGRA binaryOr(BGRA dest, BGRA src) {
+	inline BGRA binaryOr(BGRA dest, BGRA src) {
 		return BGRA(
 			dest.b | src.b,
 			dest.g | src.b,
@@ -201,7 +202,7 @@ namespace blend
 	}
 
 	// NOR
-	BGRA binaryNor(BGRA dest, BGRA src) {
+	inline BGRA binaryNor(BGRA dest, BGRA src) {
 		return BGRA(
 			~(dest.b | src.b),
 			~(dest.g | src.b),
@@ -210,7 +211,7 @@ namespace blend
 	}
 
 	// XOR
-	BGRA binaryXor(BGRA dest, BGRA src) {
+	inline BGRA binaryXor(BGRA dest, BGRA src) {
 		return BGRA(
 			dest.b ^ src.b,
 			dest.g ^ src.b,
@@ -219,7 +220,7 @@ namespace blend
 	}
 
 	// XNOR
-	BGRA binaryXnor(BGRA dest, BGRA src) {
+	inline BGRA binaryXnor(BGRA dest, BGRA src) {
 		return BGRA(
 			~(dest.b ^ src.b),
 			~(dest.g ^ src.b),
@@ -228,7 +229,7 @@ namespace blend
 	}
 
 	// IMPLICATION
-	BGRA binaryImplication(BGRA dest, BGRA src) {
+	inline BGRA binaryImplication(BGRA dest, BGRA src) {
 		return BGRA(
 			~dest.b | src.b,
 			~dest.g | src.b,
@@ -237,7 +238,7 @@ namespace blend
 	}
 
 	// NOT IMPLICATION
-	BGRA binaryNotImplication(BGRA dest, BGRA src) {
+	inline BGRA binaryNotImplication(BGRA dest, BGRA src) {
 		return BGRA(
 			dest.b & ~src.b,
 			dest.g & ~src.b,
@@ -246,7 +247,7 @@ namespace blend
 	}
 
 	// CONVERSE
-	BGRA binaryConverse(BGRA dest, BGRA src) {
+	inline BGRA binaryConverse(BGRA dest, BGRA src) {
 		return BGRA(
 			dest.b | ~src.b,
 			dest.g | ~src.b,
@@ -255,7 +256,7 @@ namespace blend
 	}
 
 	// NOT CONVERSE
-	BGRA binaryNotConverse(BGRA dest, BGRA src) {
+	inline BGRA binaryNotConverse(BGRA dest, BGRA src) {
 		return BGRA(
 			~dest.b & src.b,
 			~dest.g & src.b,
@@ -263,54 +264,48 @@ namespace blend
 		);
 	}
 
-	Blend toBlend(int num) {
-		switch (num) {
-		case 0: return normal;
-		case 1: return addition;
-		case 2: return subtract;
-		case 3: return multiply;
-		case 4: return screen;
-		case 5: return overlay;
-		case 6: return lighten;
-		case 7: return darken;
-		case 8: return luminosity;
-		case 9: return color;
-		case 10: return linearBurn;
-		case 11: return linearLight;
-		case 12: return difference;
-		}
-		return normal;
+	constexpr Blend modes[] = {
+		normal, addition, subtract, multiply, screen, overlay, lighten, darken,
+		luminosity, color, linearBurn, linearLight, difference, exclusion,
+		divide, colorDodge, colorBurn, hardMix,
+		binaryAnd, binaryNand, binaryOr, binaryNor, binaryXor, binaryXnor,
+		binaryImplication, binaryNotImplication, binaryConverse, binaryNotConverse,
+	};
+
+	inline int toMode(int num) {
+		if (0 <= num && num <= 12) return num;
+		return 0;
 	}
 
-	Blend toBlend(const char* str) {
-		if (strcmp(str, "Normal") == 0) return normal;
-		else if (strcmp(str, "Addition") == 0) return addition;
-		else if (strcmp(str, "Subtract") == 0) return subtract;
-		else if (strcmp(str, "Multiply") == 0) return multiply;
-		else if (strcmp(str, "Screen") == 0) return screen;
-		else if (strcmp(str, "Overlay") == 0) return overlay;
-		else if (strcmp(str, "Lighten") == 0) return lighten;
-		else if (strcmp(str, "Darken") == 0) return darken;
-		else if (strcmp(str, "Luminosity") == 0) return luminosity;
-		else if (strcmp(str, "Color") == 0) return color;
-		else if (strcmp(str, "LinearBurn") == 0) return linearBurn;
-		else if (strcmp(str, "LinearLight") == 0) return linearLight;
-		else if (strcmp(str, "Difference") == 0) return difference;
-		else if (strcmp(str, "Exclusion") == 0) return exclusion;
-		else if (strcmp(str, "Divide") == 0) return divide;
-		else if (strcmp(str, "ColorDodge") == 0) return colorDodge;
-		else if (strcmp(str, "ColorBurn") == 0) return colorBurn;
-		else if (strcmp(str, "HardMix") == 0) return hardMix;
-		else if (strcmp(str, "AND") == 0) return binaryAnd;
-		else if (strcmp(str, "NAND") == 0) return binaryNand;
-		else if (strcmp(str, "OR") == 0) return binaryOr;
-		else if (strcmp(str, "NOR") == 0) return binaryNor;
-		else if (strcmp(str, "XOR") == 0) return binaryXor;
-		else if (strcmp(str, "XNOR") == 0) return binaryXnor;
-		else if (strcmp(str, "IMPLICATION") == 0) return binaryImplication;
-		else if (strcmp(str, "NOT IMPLICATION") == 0) return binaryNotImplication;
-		else if (strcmp(str, "CONVERSE") == 0) return binaryConverse;
-		else if (strcmp(str, "NOT CONVERSE") == 0) return binaryNotConverse;
-		else return normal;
+	inline int toMode(const char* str) {
+		if (strcmp(str, "Normal") == 0) return 0;
+		else if (strcmp(str, "Addition") == 0) return 1;
+		else if (strcmp(str, "Subtract") == 0) return 2;
+		else if (strcmp(str, "Multiply") == 0) return 3;
+		else if (strcmp(str, "Screen") == 0) return 4;
+		else if (strcmp(str, "Overlay") == 0) return 5;
+		else if (strcmp(str, "Lighten") == 0) return 6;
+		else if (strcmp(str, "Darken") == 0) return 7;
+		else if (strcmp(str, "Luminosity") == 0) return 8;
+		else if (strcmp(str, "Color") == 0) return 9;
+		else if (strcmp(str, "LinearBurn") == 0) return 10;
+		else if (strcmp(str, "LinearLight") == 0) return 11;
+		else if (strcmp(str, "Difference") == 0) return 12;
+		else if (strcmp(str, "Exclusion") == 0) return 13;
+		else if (strcmp(str, "Divide") == 0) return 14;
+		else if (strcmp(str, "ColorDodge") == 0) return 15;
+		else if (strcmp(str, "ColorBurn") == 0) return 16;
+		else if (strcmp(str, "HardMix") == 0) return 17;
+		else if (strcmp(str, "AND") == 0) return 18;
+		else if (strcmp(str, "NAND") == 0) return 19;
+		else if (strcmp(str, "OR") == 0) return 20;
+		else if (strcmp(str, "NOR") == 0) return 21;
+		else if (strcmp(str, "XOR") == 0) return 22;
+		else if (strcmp(str, "XNOR") == 0) return 23;
+		else if (strcmp(str, "IMPLICATION") == 0) return 24;
+		else if (strcmp(str, "NOT IMPLICATION") == 0) return 25;
+		else if (strcmp(str, "CONVERSE") == 0) return 26;
+		else if (strcmp(str, "NOT CONVERSE") == 0) return 27;
+		else return 0;
 	}
 }
@@ -0,0 +1,130 @@
+#include "blur.h"
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+namespace {
+	// rows blurred before they are written out transposed, so each write
+	// fills a cache line of the output column
+	constexpr int tileRows = 16;
+
+	// one box pass over a row of n premultiplied pixels, zeros outside
+	void boxRow(const BGRA* in, BGRA* out, int n, int radius) {
+		const uint32_t size = 2 * radius + 1;
+		// sum * mul >> 23 is sum / size, rounded, and fits 32 bits
+		const uint32_t mul = ((1u << 23) + size / 2) / size;
+		const uint8_t* p = reinterpret_cast<const uint8_t*>(in);
+		uint8_t* q = reinterpret_cast<uint8_t*>(out);
+
+		uint32_t sum[4] = {};
+		auto add = [&](int i) {
+			for (int c = 0; c < 4; c++) sum[c] += p[i * 4 + c];
+		};
+		auto remove = [&](int i) {
+			for (int c = 0; c < 4; c++) sum[c] -= p[i * 4 + c];
+		};
+		auto store = [&](int x) {
+			for (int c = 0; c < 4; c++) {
+				q[x * 4 + c] = static_cast<uint8_t>((sum[c] * mul + (1u << 22)) >> 23);
+			}
+		};
+
+		for (int i = 0; i <= std::min(radius, n - 1); i++) add(i);
+		// the window enters the row, slides along it and leaves it; only
+		// the first and last parts check the ends
+		const int slide0 = std::min(radius, n), slide1 = std::max(n - radius - 1, slide0);
+		int x = 0;
+		for (; x < slide0; x++) {
+			store(x);
+			if (x + radius + 1 < n) add(x + radius + 1);
+		}
+		for (; x < slide1; x++) {
+			store(x);
+			add(x + radius + 1);
+			remove(x - radius);
+		}
+		for (; x < n; x++) {
+			store(x);
+			if (x + radius + 1 < n) add(x + radius + 1);
+			remove(x - radius);
+		}
+	}
+
+	// Blurs every row of in (width x height) and writes it as a column
+	// of out (height x width), so the same function does the other
+	// direction on out.
+	void blurRowsTransposed(const BGRA* in, int width, int height, BGRA* out, int radius, ThreadPool* pool) {
+		auto band = [=](int y0, int y1) {
+			std::vector<BGRA> tile(static_cast<size_t>(tileRows) * width), scratch(width);
+			for (int ty = y0; ty < y1; ty += tileRows) {
+				const int rows = std::min(tileRows, y1 - ty);
+				for (int t = 0; t < rows; t++) {
+					BGRA* row = tile.data() + static_cast<size_t>(width) * t;
+					// the passes alternate between the buffers and end in row
+					const BGRA* from = in + static_cast<size_t>(width) * (ty + t);
+					BGRA* bufs[2] = { row, scratch.data() };
+					for (int pass = 0; pass < blur::passes; pass++) {
+						BGRA* to = bufs[pass % 2 == blur::passes % 2 ? 1 : 0];
+						boxRow(from, to, width, radius);
+						from = to;
+					}
+					if (from != row) std::copy(from, from + width, row);
+				}
+				for (int x = 0; x < width; x++) {
+					BGRA* column = out + static_cast<size_t>(height) * x + ty;
+					for (int t = 0; t < rows; t++) {
+						column[t] = tile[static_cast<size_t>(width) * t + x];
+					}
+				}
+			}
+		};
+		if (pool) {
+			pool->parallelFor(0, height, band);
+		}
+		else {
+			band(0, height);
+		}
+	}
+}
+
+namespace blur
+{
+	void box(Image& img, const Rect& rect, int radius, ThreadPool* pool) {
+		if (radius <= 0) return;
+		// a window as wide as the image already reaches every pixel, and
+		// the arithmetic below stays within int
+		radius = std::min(radius, std::max(img.width, img.height));
+		// transparent pixels further than the blur reaches from the dirty
+		// ones stay transparent
+		const int reach = passes * radius;
+		const Rect& d = img.dirty;
+		const Rect r = rect.intersected(img.bounds())
+			.intersected(Rect(d.left - reach, d.top - reach, d.right + reach, d.bottom + reach));
+		if (r.empty() || d.empty()) return;
+
+		const int w = r.width(), h = r.height();
+		const bool straight = !img.premultiplied;
+		PixelBuffer a, b;
+		a.resize(static_cast<size_t>(w) * h);
+		b.resize(static_cast<size_t>(w) * h);
+		for (int y = 0; y < h; y++) {
+			const BGRA* row = img.pixels + r.left + img.width * (r.top + y);
+			BGRA* to = a.data() + static_cast<size_t>(w) * y;
+			for (int x = 0; x < w; x++) {
+				to[x] = straight ? toPremultiplied(row[x]) : row[x];
+			}
+		}
+
+		blurRowsTransposed(a.data(), w, h, b.data(), radius, pool);
+		blurRowsTransposed(b.data(), h, w, a.data(), radius, pool);
+
+		for (int y = 0; y < h; y++) {
+			BGRA* row = img.pixels + r.left + img.width * (r.top + y);
+			const BGRA* from = a.data() + static_cast<size_t>(w) * y;
+			for (int x = 0; x < w; x++) {
+				row[x] = straight ? toStraight(from[x]) : from[x];
+			}
+		}
+		img.markDirty(r);
+	}
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "graphic.h"
+#include "threadpool.h"
+
+namespace blur
+{
+	// Box passes applied in each direction; three approximate a Gaussian
+	// with a standard deviation of about the radius.
+	constexpr int passes = 3;
+
+	// Blurs the pixels of r with running-sum box filters of the given
+	// radius, O(1) per pixel whatever the radius. Pixels outside r count
+	// as transparent. Colors are weighted by alpha, so transparent pixels
+	// don't darken the edges. radius is clamped to the larger side of img.
+	// pool may be null.
+	void box(Image& img, const Rect& r, int radius, ThreadPool* pool);
+}
@@ -0,0 +1,79 @@
+#include "cpu.h"
+#include <stdint.h>
+
+#ifdef CPU_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+namespace {
+	struct Features {
+		bool sse41 = false;
+		bool avx2 = false;
+
+		Features() {
+			int info[4];
+			cpuid(info, 0, 0);
+			const int maxLeaf = info[0];
+			if (maxLeaf < 1) return;
+
+			cpuid(info, 1, 0);
+			sse41 = (info[2] & (1 << 19)) != 0;
+			const bool osxsave = (info[2] & (1 << 27)) != 0;
+			const bool avx = (info[2] & (1 << 28)) != 0;
+			if (maxLeaf < 7 || !osxsave || !avx) return;
+
+			// the OS has to save the YMM registers on context switches
+			if ((xgetbv0() & 0x6) != 0x6) return;
+			cpuid(info, 7, 0);
+			avx2 = (info[1] & (1 << 5)) != 0;
+		}
+
+		static void cpuid(int info[4], int leaf, int subleaf) {
+#ifdef _MSC_VER
+			__cpuidex(info, leaf, subleaf);
+#else
+			unsigned int a, b, c, d;
+			__cpuid_count(leaf, subleaf, a, b, c, d);
+			info[0] = a;
+			info[1] = b;
+			info[2] = c;
+			info[3] = d;
+#endif
+		}
+
+		static uint64_t xgetbv0() {
+#ifdef _MSC_VER
+			return _xgetbv(0);
+#else
+			uint32_t a, d;
+			__asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+			return (static_cast<uint64_t>(d) << 32) | a;
+#endif
+		}
+	};
+
+	const Features& features() {
+		static const Features f;
+		return f;
+	}
+}
+
+bool cpu::hasSSE41() {
+	return features().sse41;
+}
+
+bool cpu::hasAVX2() {
+	return features().avx2;
+}
+#else
+bool cpu::hasSSE41() {
+	return false;
+}
+
+bool cpu::hasAVX2() {
+	return false;
+}
+#endif
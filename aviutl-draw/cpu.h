@@ -0,0 +1,10 @@
+#pragma once
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define CPU_X86 1
+#endif
+
+namespace cpu {
+	bool hasSSE41();
+	bool hasAVX2();
+}
@@ -0,0 +1,53 @@
+#include "fill.h"
+#include <string.h>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FILL_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace fill
+{
+	namespace {
+		// runs from here (a 1080p canvas is 7.9 MiB) skip the cache; smaller
+		// ones, up to 720p, are likely read again by the next draw before
+		// they'd be evicted
+		constexpr size_t streamBytes = 4 << 20;
+	}
+
+	void pixels(void* dest, size_t count, uint32_t value) {
+		uint32_t* p = static_cast<uint32_t*>(dest);
+#ifdef FILL_SSE2
+		if (count * sizeof(uint32_t) >= streamBytes) {
+			for (; count > 0 && reinterpret_cast<uintptr_t>(p) % 16 != 0; count--) {
+				*p++ = value;
+			}
+			const __m128i v = _mm_set1_epi32(static_cast<int>(value));
+			__m128i* q = reinterpret_cast<__m128i*>(p);
+			for (; count >= 16; count -= 16, q += 4) {
+				_mm_stream_si128(q, v);
+				_mm_stream_si128(q + 1, v);
+				_mm_stream_si128(q + 2, v);
+				_mm_stream_si128(q + 3, v);
+			}
+			_mm_sfence();
+			p = reinterpret_cast<uint32_t*>(q);
+		}
+#endif
+		const uint8_t byte = static_cast<uint8_t>(value);
+		if (value == byte * 0x01010101u) {
+			memset(p, byte, count * sizeof(uint32_t));
+		}
+		else {
+			std::fill_n(p, count, value);
+		}
+	}
+
+	void clearTransparent(void* dest, size_t count) {
+		uint32_t* p = static_cast<uint32_t*>(dest);
+		for (size_t i = 0; i < count; i++) {
+			p[i] = (p[i] >> 24) ? p[i] : 0;
+		}
+	}
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace fill
+{
+	// writes value to the count 32 bit pixels at dest. Fills larger than
+	// the caches bypass them with streaming stores.
+	void pixels(void* dest, size_t count, uint32_t value);
+
+	// zeroes the count 32 bit pixels at dest whose top byte, the alpha of
+	// BGRA, is zero
+	void clearTransparent(void* dest, size_t count);
+}
@@ -1,8 +1,13 @@
 #pragma once
 
 #include <stdint.h>
-#include <vector>
+#include <string.h>
+#include <algorithm>
+#include <array>
+#include <utility>
 #include "mat.h"
+#include "arena.h"
+#include "fill.h"
 
 struct YCbCr;
 
@@ -21,6 +26,48 @@ struct BGRA {
 	BGRA(const YCbCr c);
 };
 
+inline void fillPixels(BGRA* dest, size_t count, BGRA color) {
+	uint32_t v;
+	memcpy(&v, &color, sizeof(v));
+	fill::pixels(dest, count, v);
+}
+
+// x / 255 rounded to nearest, exact for 0 <= x <= 255 * 255
+inline int div255(int x) {
+	x += 128;
+	return (x + (x >> 8)) >> 8;
+}
+
+// (255 << 16) / a rounded, so unpremultiplying is a multiply and a shift
+constexpr std::array<uint32_t, 256> makeAlphaReciprocals() {
+	std::array<uint32_t, 256> table{};
+	for (uint32_t a = 1; a < 256; a++) {
+		table[a] = ((255u << 16) + a / 2) / a;
+	}
+	return table;
+}
+
+inline constexpr auto alphaReciprocals = makeAlphaReciprocals();
+
+inline BGRA toPremultiplied(BGRA c) {
+	return BGRA(
+		static_cast<uint8_t>(div255(c.b * c.a)),
+		static_cast<uint8_t>(div255(c.g * c.a)),
+		static_cast<uint8_t>(div255(c.r * c.a)),
+		c.a
+	);
+}
+
+// inverse of toPremultiplied(); toStraight(toPremultiplied(c)) can differ
+// from c when c.a is small, but toPremultiplied(toStraight(p)) == p
+inline BGRA toStraight(BGRA c) {
+	const uint32_t r = alphaReciprocals[c.a];
+	auto f = [=](uint32_t v) {
+		return static_cast<uint8_t>(std::min<uint32_t>((v * r + 0x8000) >> 16, 255));
+	};
+	return BGRA(f(c.b), f(c.g), f(c.r), c.a);
+}
+
 struct YCbCr {
 	short y;
 	short cb;
@@ -35,6 +82,89 @@ struct YCbCr {
 	YCbCr(const BGRA rgb);
 };
 
+// The conversions below are the ITU-R BT.601 ones with their decimal
+// coefficients, evaluated exactly in integers and truncated as a cast
+// from double would. Only a result that is exactly an integer could end
+// up on either side of it in double arithmetic, so those few values are
+// still computed with the original double expression.
+inline YCbCr::YCbCr(const BGRA rgb) {
+	const int vy = 299 * rgb.r + 587 * rgb.g + 114 * rgb.b;
+	const int vcb = -168736 * rgb.r - 331264 * rgb.g + 500000 * rgb.b;
+	const int vcr = 500000 * rgb.r - 418688 * rgb.g - 81312 * rgb.b;
+	y = static_cast<short>(vy / 1000);
+	cb = static_cast<short>(vcb / 1000000);
+	cr = static_cast<short>(vcr / 1000000);
+	if (vy % 1000 == 0) {
+		y = static_cast<short>(0.299 * rgb.r + 0.587 * rgb.g + 0.114 * rgb.b);
+	}
+	if (vcb % 1000000 == 0) {
+		cb = static_cast<short>(-0.168736 * rgb.r - 0.331264 * rgb.g + 0.5 * rgb.b);
+	}
+	if (vcr % 1000000 == 0) {
+		cr = static_cast<short>(0.5 * rgb.r - 0.418688 * rgb.g - 0.081312 * rgb.b);
+	}
+}
+
+// c as produced by YCbCr(BGRA), or at least |y|, |cb|, |cr| <= 1024
+inline BGRA::BGRA(const YCbCr c) {
+	auto channel = [](int v, int scale) {
+		return static_cast<uint8_t>(std::min(std::max(v, 0) / scale, 255));
+	};
+	const int vr = 1000 * c.y + 1402 * c.cr;
+	const int vg = 1000000 * c.y - 344136 * c.cb - 714136 * c.cr;
+	const int vb = 1000 * c.y + 1772 * c.cb;
+	a = 255;
+	r = channel(vr, 1000);
+	g = channel(vg, 1000000);
+	b = channel(vb, 1000);
+	if (vr % 1000 == 0) {
+		r = static_cast<uint8_t>(std::clamp(c.y + 1.402 * c.cr, 0., 255.));
+	}
+	if (vg % 1000000 == 0) {
+		g = static_cast<uint8_t>(std::clamp(c.y - 0.344136 * c.cb - 0.714136 * c.cr, 0., 255.));
+	}
+	if (vb % 1000 == 0) {
+		b = static_cast<uint8_t>(std::clamp(c.y + 1.772 * c.cb, 0., 255.));
+	}
+}
+
+// [left, right) x [top, bottom)
+struct Rect {
+	int left;
+	int top;
+	int right;
+	int bottom;
+
+	Rect() : left(0), top(0), right(0), bottom(0) {}
+
+	Rect(int left, int top, int right, int bottom)
+		: left(left), top(top), right(right), bottom(bottom)
+	{}
+
+	bool empty() const {
+		return left >= right || top >= bottom;
+	}
+
+	int width() const {
+		return right - left;
+	}
+
+	int height() const {
+		return bottom - top;
+	}
+
+	// smallest rect containing both, ignoring empty ones
+	Rect united(const Rect& r) const {
+		if (r.empty()) return *this;
+		if (empty()) return r;
+		return Rect(std::min(left, r.left), std::min(top, r.top), std::max(right, r.right), std::max(bottom, r.bottom));
+	}
+
+	Rect intersected(const Rect& r) const {
+		return Rect(std::max(left, r.left), std::max(top, r.top), std::min(right, r.right), std::min(bottom, r.bottom));
+	}
+};
+
 struct ReadOnlyImage {
 	const BGRA* data;
 	int width;
@@ -65,49 +195,198 @@ struct ReadOnlyImage {
 	}
 };
 
+// Pixel storage taken from the shared arena. resize() keeps the block when
+// it is large enough and otherwise discards the contents; pixels are never
+// initialized here.
+class PixelBuffer {
+public:
+	PixelBuffer() : ptr(nullptr), capacity(0) {}
+
+	PixelBuffer(PixelBuffer&& other) noexcept : ptr(other.ptr), capacity(other.capacity) {
+		other.ptr = nullptr;
+		other.capacity = 0;
+	}
+
+	PixelBuffer& operator=(PixelBuffer&& other) noexcept {
+		std::swap(ptr, other.ptr);
+		std::swap(capacity, other.capacity);
+		return *this;
+	}
+
+	~PixelBuffer() {
+		Arena::shared().release(ptr, capacity);
+	}
+
+	void resize(size_t count) {
+		if (count * sizeof(BGRA) <= capacity) return;
+		Arena::shared().release(ptr, capacity);
+		ptr = static_cast<BGRA*>(Arena::shared().acquire(count * sizeof(BGRA), capacity));
+	}
+
+	BGRA* data() const {
+		return ptr;
+	}
+
+	inline BGRA& operator[](size_t i) const {
+		return ptr[i];
+	}
+
+private:
+	BGRA* ptr;
+	size_t capacity;
+};
+
+// Pixels are either owned (data) or a view of memory owned by the caller
+// (bind). Either way they are accessed through pixels.
+// premultiplied tells the format the pixels are currently stored in.
+// Outside dirty every pixel is transparent black; whoever writes pixels
+// grows it with markDirty(). The caller can write bound memory at any
+// time, so for a view it always covers the whole image.
 struct Image {
-	std::vector<BGRA> data;
+	PixelBuffer data;
+	BGRA* pixels;
 	int width;
 	int height;
+	bool premultiplied;
+	Rect dirty;
 
-	Image() : data(), width(0), height(0) {}
+	Image() : data(), pixels(nullptr), width(0), height(0), premultiplied(false) {}
 
-	Image(const BGRA* buf, int w, int h) : data(w* h), width(w), height(h) {
-		for (int i = 0; i < w * h; i++) {
-			data[i] = buf[i];
+	Image(const BGRA* buf, int w, int h) : data(), pixels(nullptr), width(w), height(h), premultiplied(false) {
+		data.resize(w * h);
+		pixels = data.data();
+		memcpy(pixels, buf, sizeof(BGRA) * w * h);
+		dirty = bounds();
+	}
+
+	Image(const Image& other)
+		: data(), pixels(other.pixels), width(other.width), height(other.height), premultiplied(other.premultiplied)
+		, dirty(other.dirty)
+	{
+		if (other.owns()) {
+			setData(other.pixels, other.width, other.height);
+			premultiplied = other.premultiplied;
+			dirty = other.dirty;
 		}
 	}
 
-	void clear() {
-		for (int i = 0; i < width * height; i++) {
-			data[i] = BGRA(0, 0, 0, 0);
+	Image& operator=(const Image& other) {
+		if (this == &other) return *this;
+		if (other.owns()) {
+			setData(other.pixels, other.width, other.height);
+		}
+		else {
+			bind(other.pixels, other.width, other.height);
 		}
+		premultiplied = other.premultiplied;
+		dirty = other.dirty;
+		return *this;
+	}
+
+	bool owns() const {
+		return pixels == data.data();
+	}
+
+	Rect bounds() const {
+		return Rect(0, 0, width, height);
+	}
+
+	void markDirty(const Rect& r) {
+		dirty = dirty.united(r.intersected(bounds()));
+	}
+
+	// zeroes the dirty pixels, or all of them when bound
+	void clear() {
+		fill(owns() ? dirty : bounds(), BGRA(0, 0, 0, 0));
+		dirty = owns() ? Rect() : bounds();
 	}
 
 	void clear(int w, int h) {
+		if (owns() && w == width && h == height) {
+			clear();
+			premultiplied = false;
+			return;
+		}
 		width = w;
 		height = h;
+		premultiplied = false;
 		data.resize(w * h);
-		for (int i = 0; i < w * h; i++) {
-			data[i] = BGRA(0, 0, 0, 0);
+		pixels = data.data();
+		fillPixels(pixels, static_cast<size_t>(w) * h, BGRA(0, 0, 0, 0));
+		dirty = Rect();
+	}
+
+	// sets the pixels of r to color, which is in the format of the image
+	void fill(const Rect& rect, BGRA color) {
+		const Rect r = rect.intersected(bounds());
+		if (r.empty()) return;
+		if (r.width() == width) {
+			fillPixels(pixels + width * r.top, static_cast<size_t>(width) * r.height(), color);
+		}
+		else {
+			for (int y = r.top; y < r.bottom; y++) {
+				fillPixels(pixels + r.left + width * y, r.width(), color);
+			}
+		}
+		if (color.b | color.g | color.r | color.a) {
+			markDirty(r);
 		}
 	}
 
 	void setData(const BGRA* buf, int w, int h) {
 		width = w;
 		height = h;
+		premultiplied = false;
 		data.resize(w * h);
-		for (int i = 0; i < w * h; i++) {
-			data[i] = buf[i];
+		pixels = data.data();
+		// buf can be these pixels, handed back after getimage()
+		memmove(pixels, buf, sizeof(BGRA) * w * h);
+		dirty = bounds();
+	}
+
+	// draw straight into buf without copying; buf must outlive the binding
+	void bind(BGRA* buf, int w, int h) {
+		width = w;
+		height = h;
+		pixels = buf;
+		premultiplied = false;
+		dirty = bounds();
+	}
+
+	// converts the pixels in place, does nothing when already in that format.
+	// Transparent black is the same in both, so only dirty is converted.
+	void premultiply() {
+		if (premultiplied) return;
+		forEachDirty([](BGRA& p) { p = toPremultiplied(p); });
+		premultiplied = true;
+	}
+
+	void unpremultiply() {
+		if (!premultiplied) return;
+		forEachDirty([](BGRA& p) { p = toStraight(p); });
+		premultiplied = false;
+	}
+
+	// the straight pixels of r packed into out, transparent outside the image
+	void copyRegion(const Rect& r, Image& out) const {
+		out.clear(r.width(), r.height());
+		const Rect src = r.intersected(dirty);
+		for (int y = src.top; y < src.bottom; y++) {
+			const BGRA* row = pixels + width * y;
+			BGRA* to = out.pixels + out.width * (y - r.top) - r.left;
+			for (int x = src.left; x < src.right; x++) {
+				to[x] = premultiplied ? toStraight(row[x]) : row[x];
+			}
 		}
+		out.dirty = out.bounds();
 	}
 
 	inline BGRA getPixel(int x, int y) const {
-		return data[x + width * y];
+		return pixels[x + width * y];
 	}
 
 	inline void setPixel(int x, int y, const BGRA px) {
-		data[x + width * y] = px;
+		pixels[x + width * y] = px;
 	}
 
 	template<class T>
@@ -117,6 +396,18 @@ struct Image {
 		if (x < 0 || width <= x || y < 0 || height <= y) {
 			return BGRA{ 0,0,0,0 };
 		}
-		return data[x + width * y];
+		return pixels[x + width * y];
+	}
+
+private:
+	template<class F>
+	void forEachDirty(F&& f) {
+		const Rect r = owns() ? dirty : bounds();
+		for (int y = r.top; y < r.bottom; y++) {
+			BGRA* row = pixels + width * y;
+			for (int x = r.left; x < r.right; x++) {
+				f(row[x]);
+			}
+		}
 	}
 };
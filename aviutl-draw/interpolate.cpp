@@ -0,0 +1,70 @@
+#include "interpolate.h"
+#include "cpu.h"
+#include "resample.h"
+
+namespace interpolate {
+	void nearestNeighborSpan(const ReadOnlyImage& img, const Vec2<int32_t>* pts, BGRA* out, int n) {
+		for (int i = 0; i < n; i++) {
+			// same truncation toward zero as ReadOnlyImage::samplePixel
+			int32_t vx = pts[i].x + fixedOne / 2;
+			int32_t vy = pts[i].y + fixedOne / 2;
+			int x = vx >= 0 ? vx >> fixedShift : -(-vx >> fixedShift);
+			int y = vy >= 0 ? vy >> fixedShift : -(-vy >> fixedShift);
+			out[i] = img.getPixelSafe(x, y);
+		}
+	}
+
+	BGRA bilinearPixel(const ReadOnlyImage& img, Vec2<int32_t> p) {
+		int x = p.x >> fixedShift;
+		int y = p.y >> fixedShift;
+		int wx = (p.x & (fixedOne - 1)) >> 2;
+		int wy = (p.y & (fixedOne - 1)) >> 2;
+		auto c1 = img.getPixelSafe(x, y);
+		auto c2 = img.getPixelSafe(x, y + 1);
+		auto c3 = img.getPixelSafe(x + 1, y);
+		auto c4 = img.getPixelSafe(x + 1, y + 1);
+
+		auto f = [=](int p1, int p2, int p3, int p4) {
+			int top = (p1 * (16384 - wx) + p3 * wx) >> 6;
+			int bottom = (p2 * (16384 - wx) + p4 * wx) >> 6;
+			return static_cast<uint8_t>((top * (16384 - wy) + bottom * wy) >> 22);
+		};
+		return BGRA(
+			f(c1.b, c2.b, c3.b, c4.b),
+			f(c1.g, c2.g, c3.g, c4.g),
+			f(c1.r, c2.r, c3.r, c4.r),
+			f(c1.a, c2.a, c3.a, c4.a)
+		);
+	}
+
+	void bilinearSpan(const ReadOnlyImage& img, const Vec2<int32_t>* pts, BGRA* out, int n) {
+		for (int i = 0; i < n; i++) {
+			out[i] = bilinearPixel(img, pts[i]);
+		}
+	}
+
+	Sampler sampler(int mode) {
+		switch (mode) {
+		case 0:
+			return nearestNeighborSpan;
+		case 1:
+		case mipmapMode:
+#ifdef CPU_X86
+			if (cpu::hasAVX2()) return bilinearSpanAVX2;
+			if (cpu::hasSSE41()) return bilinearSpanSSE41;
+#endif
+			return bilinearSpan;
+		case bicubicMode:
+#ifdef CPU_X86
+			if (cpu::hasSSE41()) return resample::bicubicSpanSSE41;
+#endif
+			return resample::bicubicSpan;
+		case lanczos3Mode:
+#ifdef CPU_X86
+			if (cpu::hasSSE41()) return resample::lanczos3SpanSSE41;
+#endif
+			return resample::lanczos3Span;
+		}
+		return bilinearSpan;
+	}
+}
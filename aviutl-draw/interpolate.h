@@ -1,6 +1,7 @@
 #pragma once
 
 #include "graphic.h"
+#include <stdint.h>
 #include <cmath>
 
 namespace interpolate {
@@ -30,4 +31,73 @@ namespace interpolate {
 			static_cast<uint8_t>((1 - dx) * (1 - dy) * c1.a + (1 - dx) * dy * c2.a + dx * (1 - dy) * c3.a + dx * dy * c4.a)
 		);
 	}
+
+	template<class T>
+	constexpr Interpolate<T> modes[] = { nearestNeighbor<T>, bilinear<T> };
+
+	// bilinear on the two mip levels around the scale of a draw, see
+	// mipmap.h; points are sampled with the bilinear sampler
+	constexpr int mipmapMode = 2;
+	// see resample.h
+	constexpr int bicubicMode = 3;
+	constexpr int lanczos3Mode = 4;
+	constexpr int modeCount = 5;
+
+	constexpr int fixedShift = 16;
+	constexpr int32_t fixedOne = 1 << fixedShift;
+
+	// Converts a source coordinate to 16.16 fixed point.
+	// Anything beyond three texels outside the image (the Lanczos-3 radius)
+	// samples as transparent, so clamping there keeps the result and the
+	// value in range.
+	template<class T>
+	inline int32_t toFixed(T v, int size) {
+		if (!(v >= -4)) v = -4;
+		else if (!(v <= size + 3)) v = static_cast<T>(size + 3);
+		return static_cast<int32_t>(std::floor(v * fixedOne));
+	}
+
+	template<class T>
+	inline Vec2<int32_t> toFixed(const ReadOnlyImage& img, Vec2<T> p) {
+		return Vec2<int32_t>{ toFixed(p.x, img.width), toFixed(p.y, img.height) };
+	}
+
+	// current point of a 32.32 scan line as clamped 16.16
+	inline Vec2<int32_t> toFixed(const ReadOnlyImage& img, const FixedScanLine& line) {
+		auto clamp = [](int64_t v, int size) {
+			const int64_t lo = -(int64_t{ 4 } << 32);
+			const int64_t hi = static_cast<int64_t>(size + 3) << 32;
+			return static_cast<int32_t>((v < lo ? lo : v > hi ? hi : v) >> 16);
+		};
+		return Vec2<int32_t>{ clamp(line.u, img.width), clamp(line.v, img.height) };
+	}
+
+	// samples n pixels at 16.16 fixed point coordinates
+	using Sampler = void(*)(const ReadOnlyImage& img, const Vec2<int32_t>* pts, BGRA* out, int n);
+
+	void nearestNeighborSpan(const ReadOnlyImage& img, const Vec2<int32_t>* pts, BGRA* out, int n);
+
+	// bilinear with 14 bit weights, within 1 of bilinear()
+	BGRA bilinearPixel(const ReadOnlyImage& img, Vec2<int32_t> p);
+	void bilinearSpan(const ReadOnlyImage& img, const Vec2<int32_t>* pts, BGRA* out, int n);
+	void bilinearSpanSSE41(const ReadOnlyImage& img, const Vec2<int32_t>* pts, BGRA* out, int n);
+	void bilinearSpanAVX2(const ReadOnlyImage& img, const Vec2<int32_t>* pts, BGRA* out, int n);
+
+	// picks the fastest implementation the CPU supports
+	Sampler sampler(int mode);
+
+	// corners of the source area outside which the sampler of mode
+	// only returns transparent pixels
+	template<class T>
+	void footprint(int mode, const ReadOnlyImage& img, Vec2<T> corners[4]) {
+		// texels a point reaches past the one it falls on, on either side
+		T reach = mode == bicubicMode ? 1 : mode == lanczos3Mode ? 2 : 0;
+		T lo = (mode == 0 ? static_cast<T>(-1.5) : static_cast<T>(-1)) - reach;
+		T right = img.width + (mode == 0 ? static_cast<T>(-0.5) : static_cast<T>(0)) + reach;
+		T bottom = img.height + (mode == 0 ? static_cast<T>(-0.5) : static_cast<T>(0)) + reach;
+		corners[0] = Vec2<T>{ lo, lo };
+		corners[1] = Vec2<T>{ right, lo };
+		corners[2] = Vec2<T>{ right, bottom };
+		corners[3] = Vec2<T>{ lo, bottom };
+	}
 }
@@ -0,0 +1,69 @@
+#include "interpolate.h"
+#include "cpu.h"
+
+#ifdef CPU_X86
+#include <immintrin.h>
+
+// Header inline functions are not called from here: a copy compiled with
+// these instructions could be picked by the linker for the scalar callers.
+namespace {
+	inline bool inside(const ReadOnlyImage& img, Vec2<int32_t> p) {
+		int x = p.x >> interpolate::fixedShift;
+		int y = p.y >> interpolate::fixedShift;
+		return 0 <= x && x + 1 < img.width && 0 <= y && y + 1 < img.height;
+	}
+
+	inline __m128i load(const ReadOnlyImage& img, Vec2<int32_t> p) {
+		int x = p.x >> interpolate::fixedShift;
+		int y = p.y >> interpolate::fixedShift;
+		const BGRA* top = img.data + x + img.width * y;
+		return _mm_unpacklo_epi64(
+			_mm_loadl_epi64(reinterpret_cast<const __m128i*>(top)),
+			_mm_loadl_epi64(reinterpret_cast<const __m128i*>(top + img.width)));
+	}
+
+	inline __m128i weight(int32_t f, bool horizontal) {
+		int w = (f & (interpolate::fixedOne - 1)) >> 2;
+		return horizontal ? _mm_set1_epi32((w << 16) | (16384 - w)) : _mm_set1_epi32(w);
+	}
+
+	// b,g,r,a of pixel p in the low lane and of q in the high lane
+	inline __m256i sample(const ReadOnlyImage& img, Vec2<int32_t> p, Vec2<int32_t> q) {
+		const __m256i shuffle = _mm256_setr_epi8(
+			0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15,
+			0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15);
+		__m256i px = _mm256_shuffle_epi8(_mm256_set_m128i(load(img, q), load(img, p)), shuffle);
+
+		__m256i wx = _mm256_set_m128i(weight(q.x, true), weight(p.x, true));
+		__m256i wy = _mm256_set_m128i(weight(q.y, false), weight(p.y, false));
+		__m256i t = _mm256_madd_epi16(_mm256_unpacklo_epi8(px, _mm256_setzero_si256()), wx);
+		__m256i b = _mm256_madd_epi16(_mm256_unpackhi_epi8(px, _mm256_setzero_si256()), wx);
+		t = _mm256_mullo_epi32(_mm256_srli_epi32(t, 6), _mm256_sub_epi32(_mm256_set1_epi32(16384), wy));
+		b = _mm256_mullo_epi32(_mm256_srli_epi32(b, 6), wy);
+		return _mm256_srli_epi32(_mm256_add_epi32(t, b), 22);
+	}
+}
+
+void interpolate::bilinearSpanAVX2(const ReadOnlyImage& img, const Vec2<int32_t>* pts, BGRA* out, int n) {
+	// after packing the low lane holds pixels 0,2 and the high lane 1,3
+	const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		if (inside(img, pts[i]) && inside(img, pts[i + 1])
+			&& inside(img, pts[i + 2]) && inside(img, pts[i + 3]))
+		{
+			__m256i p = _mm256_packus_epi32(sample(img, pts[i], pts[i + 1]), sample(img, pts[i + 2], pts[i + 3]));
+			p = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(p, p), order);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm256_castsi256_si128(p));
+		}
+		else {
+			for (int j = i; j < i + 4; j++) {
+				out[j] = bilinearPixel(img, pts[j]);
+			}
+		}
+	}
+	for (; i < n; i++) {
+		out[i] = bilinearPixel(img, pts[i]);
+	}
+}
+#endif
@@ -0,0 +1,60 @@
+#include "interpolate.h"
+#include "cpu.h"
+
+#ifdef CPU_X86
+#include <smmintrin.h>
+
+// Header inline functions are not called from here: a copy compiled with
+// these instructions could be picked by the linker for the scalar callers.
+namespace {
+	inline bool inside(const ReadOnlyImage& img, Vec2<int32_t> p) {
+		int x = p.x >> interpolate::fixedShift;
+		int y = p.y >> interpolate::fixedShift;
+		return 0 <= x && x + 1 < img.width && 0 <= y && y + 1 < img.height;
+	}
+
+	// b,g,r,a of one pixel as 32 bit lanes, 8 bit integer part
+	inline __m128i sample(const ReadOnlyImage& img, Vec2<int32_t> p) {
+		const __m128i shuffle = _mm_setr_epi8(0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15);
+		int x = p.x >> interpolate::fixedShift;
+		int y = p.y >> interpolate::fixedShift;
+		int wx = (p.x & (interpolate::fixedOne - 1)) >> 2;
+		int wy = (p.y & (interpolate::fixedOne - 1)) >> 2;
+
+		const BGRA* top = img.data + x + img.width * y;
+		__m128i px = _mm_unpacklo_epi64(
+			_mm_loadl_epi64(reinterpret_cast<const __m128i*>(top)),
+			_mm_loadl_epi64(reinterpret_cast<const __m128i*>(top + img.width)));
+		// pair up the left and right texel of every channel
+		px = _mm_shuffle_epi8(px, shuffle);
+
+		__m128i weight = _mm_set1_epi32((wx << 16) | (16384 - wx));
+		__m128i t = _mm_madd_epi16(_mm_cvtepu8_epi16(px), weight);
+		__m128i b = _mm_madd_epi16(_mm_unpackhi_epi8(px, _mm_setzero_si128()), weight);
+		t = _mm_mullo_epi32(_mm_srli_epi32(t, 6), _mm_set1_epi32(16384 - wy));
+		b = _mm_mullo_epi32(_mm_srli_epi32(b, 6), _mm_set1_epi32(wy));
+		return _mm_srli_epi32(_mm_add_epi32(t, b), 22);
+	}
+}
+
+void interpolate::bilinearSpanSSE41(const ReadOnlyImage& img, const Vec2<int32_t>* pts, BGRA* out, int n) {
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		if (inside(img, pts[i]) && inside(img, pts[i + 1])
+			&& inside(img, pts[i + 2]) && inside(img, pts[i + 3]))
+		{
+			__m128i p01 = _mm_packus_epi32(sample(img, pts[i]), sample(img, pts[i + 1]));
+			__m128i p23 = _mm_packus_epi32(sample(img, pts[i + 2]), sample(img, pts[i + 3]));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(p01, p23));
+		}
+		else {
+			for (int j = i; j < i + 4; j++) {
+				out[j] = bilinearPixel(img, pts[j]);
+			}
+		}
+	}
+	for (; i < n; i++) {
+		out[i] = bilinearPixel(img, pts[i]);
+	}
+}
+#endif
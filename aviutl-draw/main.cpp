@@ -1,22 +1,109 @@
 #include <stdint.h>
+#include <limits.h>
 #include <lua.hpp>
 #include <vector>
 #include <algorithm>
 #include <numbers>
-#include <Windows.h>
+#include <memory>
+#include <map>
+#include <deque>
+#include <functional>
+#include <string>
+#include <system_error>
 
 #include "mat.h"
 #include "graphic.h"
 #include "composite.h"
 #include "blend.h"
 #include "interpolate.h"
+#include "render.h"
+#include "batch.h"
+#include "mipmap.h"
+#include "threadpool.h"
+#include "arena.h"
+#include "profile.h"
+#include "shape.h"
+#include "blur.h"
+
+static std::map<std::string, Image> canvases;
+static Image* dest = &canvases["0"];
+static int compositeMode = 3;
+static int blendMode = 0;
+static int interpolateMode = 1;
+static bool premultiplied = false;
+static bool antialias = false;
+static std::unique_ptr<ThreadPool> pool;
+
+// the packed pixels getImage(x,y,w,h) returned last
+static Image region;
+
+// mip pyramids of canvases drawn with drawCanvas(), dropped when the
+// canvas is written
+static std::map<const Image*, std::shared_ptr<const mipmap::Pyramid>> canvasPyramids;
+
+// commands recorded between begin() and flush(), with copies of their
+// sources since scripts reuse the getpixeldata() buffer
+static bool recording = false;
+static std::vector<batch::Command> recorded;
+static std::deque<Image> recordedSources;
+
+// dest is about to change, so its pyramid would be stale
+void dropPyramid() {
+	canvasPyramids.erase(dest);
+}
+
+template<class F>
+void forEachBand(int sy, int ey, F&& func) {
+	if (pool) {
+		pool->parallelFor(sy, ey, func);
+	}
+	else {
+		func(sy, ey);
+	}
+}
 
-using Number = double;
+// draws the commands tile by tile, the tiles in parallel
+void drawTiles(const std::vector<batch::Command>& commands) {
+	if (commands.empty()) return;
 
-static Image dest;
-static composite::Composite compositeMode = composite::sourceOver;
-static blend::Blend blendMode = blend::normal;
-static interpolate::Interpolate<Number> interpolateFunc = interpolate::bilinear;
+	dropPyramid();
+	for (const auto& cmd : commands) {
+		dest->markDirty(cmd.bounds);
+	}
+	const batch::TileBins bins(commands, dest->width, dest->height);
+	forEachBand(0, bins.count(), [&](int t0, int t1) {
+		for (int t = t0; t < t1; t++) {
+			bins.draw(*dest, commands, t);
+		}
+	});
+}
+
+// draws what was recorded so far; called before anything that reads or
+// replaces dest, so recording never changes the result
+void flushRecorded() {
+	drawTiles(recorded);
+	recorded.clear();
+	recordedSources.clear();
+}
+
+// draws cmd now, or keeps it for flush() while recording
+void submit(const batch::Command& cmd) {
+	if (cmd.bounds.empty()) return;
+	dropPyramid();
+	dest->markDirty(cmd.bounds);
+
+	if (recording) {
+		profile::Timer timer(cmd.function, profile::setup);
+		const Image& copy = recordedSources.emplace_back(cmd.src.data, cmd.src.width, cmd.src.height);
+		recorded.push_back(cmd);
+		recorded.back().setSource(ReadOnlyImage(copy.pixels, copy.width, copy.height));
+		return;
+	}
+
+	forEachBand(cmd.bounds.top, cmd.bounds.bottom, [&](int y0, int y1) {
+		cmd.draw(*dest, Rect(cmd.bounds.left, y0, cmd.bounds.right, y1));
+	});
+}
 
 int version(lua_State* L) {
 	lua_pushstring(L, "0.1.0beta1");
@@ -24,23 +111,99 @@ int version(lua_State* L) {
 }
 
 int clear(lua_State* L) {
+	flushRecorded();
+	mipmap::clearCache();
+	dropPyramid();
 	if (lua_gettop(L) < 2) {
-		dest.clear();
+		dest->clear();
 	}
 	else {
 		int w = lua_tointeger(L, 1);
-		int h = lua_tointeger(L, 1);
-		dest.clear(w, h);
+		int h = lua_tointeger(L, 2);
+		dest->clear(w, h);
 	}
 	return 0;
 }
 
+// fill(color [,x,y,w,h [,alpha]]): sets the pixels of the area, or of the
+// whole canvas, to color (0xRRGGBB) regardless of the composite and blend
+int fillImage(lua_State* L) {
+	const int argn = lua_gettop(L);
+	if (argn < 1) {
+		return luaL_error(L, "fill() require 1 arg");
+	}
+	flushRecorded();
+
+	const uint32_t rgb = static_cast<uint32_t>(lua_tointeger(L, 1));
+	Rect r = dest->bounds();
+	if (argn >= 5) {
+		const int x = lua_tointeger(L, 2);
+		const int y = lua_tointeger(L, 3);
+		r = Rect(x, y, x + static_cast<int>(lua_tointeger(L, 4)), y + static_cast<int>(lua_tointeger(L, 5)));
+	}
+	const Number alpha = std::clamp(static_cast<Number>((argn >= 6) ? lua_tonumber(L, 6) : 1),
+		static_cast<Number>(0), static_cast<Number>(1));
+
+	BGRA color(
+		static_cast<uint8_t>(rgb),
+		static_cast<uint8_t>(rgb >> 8),
+		static_cast<uint8_t>(rgb >> 16),
+		static_cast<uint8_t>(alpha * 255 + 0.5));
+	if (color.a == 0) {
+		color = BGRA(0, 0, 0, 0);
+	}
+	dropPyramid();
+	dest->fill(r, dest->premultiplied ? toPremultiplied(color) : color);
+	return 0;
+}
+
+// blur(radius [,x,y,w,h]): blurs the area, or the whole canvas, with a
+// Gaussian of a standard deviation of about radius
+int blurImage(lua_State* L) {
+	const int argn = lua_gettop(L);
+	if (argn < 1) {
+		return luaL_error(L, "blur() require 1 arg");
+	}
+	flushRecorded();
+
+	// blur::box() clamps it further, to the size of the canvas
+	const int radius = static_cast<int>(std::clamp<lua_Integer>(lua_tointeger(L, 1), 0, INT_MAX));
+	Rect r = dest->bounds();
+	if (argn >= 5) {
+		const int x = lua_tointeger(L, 2);
+		const int y = lua_tointeger(L, 3);
+		r = Rect(x, y, x + static_cast<int>(lua_tointeger(L, 4)), y + static_cast<int>(lua_tointeger(L, 5)));
+	}
+	dropPyramid();
+	blur::box(*dest, r, radius, pool.get());
+	return 0;
+}
+
 int setImage(lua_State* L) {
 	if (lua_gettop(L) < 3) {
 		return luaL_error(L, "setImage() require 3 args");
 	}
+	flushRecorded();
+	mipmap::clearCache();
+	dropPyramid();
+
+	dest->setData(
+		static_cast<BGRA*>(lua_touserdata(L, 1)),
+		lua_tointeger(L, 2),
+		lua_tointeger(L, 3)
+	);
+	return 0;
+}
+
+int bindImage(lua_State* L) {
+	if (lua_gettop(L) < 3) {
+		return luaL_error(L, "bindImage() require 3 args");
+	}
+	flushRecorded();
+	mipmap::clearCache();
+	dropPyramid();
 
-	dest.setData(
+	dest->bind(
 		static_cast<BGRA*>(lua_touserdata(L, 1)),
 		lua_tointeger(L, 2),
 		lua_tointeger(L, 3)
@@ -48,58 +211,81 @@ int setImage(lua_State* L) {
 	return 0;
 }
 
+// getImage() returns dest itself, getImage(x,y,w,h) a packed copy of that
+// area, valid until the next such call
 int getImage(lua_State* L) {
-	lua_pushlightuserdata(L, dest.data.data());
-	lua_pushinteger(L, dest.width);
-	lua_pushinteger(L, dest.height);
+	profile::count(profile::getImage);
+	flushRecorded();
+	if (lua_gettop(L) >= 4) {
+		const int x = lua_tointeger(L, 1);
+		const int y = lua_tointeger(L, 2);
+		const int w = std::max(static_cast<int>(lua_tointeger(L, 3)), 0);
+		const int h = std::max(static_cast<int>(lua_tointeger(L, 4)), 0);
+		{
+			profile::Timer timer(profile::getImage, profile::write);
+			dest->copyRegion(Rect(x, y, x + w, y + h), region);
+		}
+		lua_pushlightuserdata(L, region.pixels);
+		lua_pushinteger(L, w);
+		lua_pushinteger(L, h);
+		return 3;
+	}
+
+	// the caller may write the pixels it gets
+	dropPyramid();
+	{
+		profile::Timer timer(profile::getImage, profile::write);
+		dest->unpremultiply();
+	}
+	lua_pushlightuserdata(L, dest->pixels);
+	lua_pushinteger(L, dest->width);
+	lua_pushinteger(L, dest->height);
 	return 3;
 }
 
+// x,y,w,h of the area drawn since the last clear(), 0,0,0,0 if none
+int getDirty(lua_State* L) {
+	const Rect& r = dest->dirty;
+	lua_pushinteger(L, r.empty() ? 0 : r.left);
+	lua_pushinteger(L, r.empty() ? 0 : r.top);
+	lua_pushinteger(L, r.empty() ? 0 : r.width());
+	lua_pushinteger(L, r.empty() ? 0 : r.height());
+	return 4;
+}
+
+int select(lua_State* L) {
+	if (lua_gettop(L) < 1) {
+		return luaL_error(L, "select() require 1 arg");
+	}
+	const char* id = luaL_checkstring(L, 1);
+	flushRecorded();
+
+	dest = &canvases[id];
+	return 0;
+}
+
+// returns the memory of a canvas other than the selected one to the arena
+int freeCanvas(lua_State* L) {
+	if (lua_gettop(L) < 1) {
+		return luaL_error(L, "freeCanvas() require 1 arg");
+	}
+
+	auto it = canvases.find(luaL_checkstring(L, 1));
+	if (it != canvases.end() && &it->second != dest) {
+		canvasPyramids.erase(&it->second);
+		canvases.erase(it);
+	}
+	return 0;
+}
+
 int setComposite(lua_State* L) {
 	if (lua_gettop(L) < 1) {
 		return luaL_error(L, "setComposite() require 1 arg");
 	}
 
-	switch (lua_tointeger(L, 1)) {
-	case 0:
-		compositeMode = composite::clear;
-		break;
-	case 1:
-		compositeMode = composite::copy;
-		break;
-	case 2:
-		compositeMode = composite::destination;
-		break;
-	case 3:
-		compositeMode = composite::sourceOver;
-		break;
-	case 4:
-		compositeMode = composite::destinationOver;
-		break;
-	case 5:
-		compositeMode = composite::sourceIn;
-		break;
-	case 6:
-		compositeMode = composite::destinationIn;
-		break;
-	case 7:
-		compositeMode = composite::sourceOut;
-		break;
-	case 8:
-		compositeMode = composite::destinationOut;
-		break;
-	case 9:
-		compositeMode = composite::sourceAtop;
-		break;
-	case 10:
-		compositeMode = composite::destinationAtop;
-		break;
-	case 11:
-		compositeMode = composite::exclusiveOR;
-		break;
-	case 12:
-		compositeMode = composite::lighter;
-		break;
+	int mode = lua_tointeger(L, 1);
+	if (0 <= mode && mode < render::compositeCount) {
+		compositeMode = mode;
 	}
 	return 0;
 }
@@ -110,10 +296,10 @@ int setBlend(lua_State* L) {
 	}
 
 	if (lua_isnumber(L, 1)) {
-		blendMode = blend::toBlend(lua_tointeger(L, 1));
+		blendMode = blend::toMode(lua_tointeger(L, 1));
 	}
 	else if (lua_isstring(L, 1)) {
-		blendMode = blend::toBlend(lua_tostring(L, 1));
+		blendMode = blend::toMode(lua_tostring(L, 1));
 	}
 	return 0;
 }
@@ -123,50 +309,118 @@ int setInterpolate(lua_State* L) {
 		return luaL_error(L, "setInterpolate() require 1 arg");
 	}
 
-	switch (lua_tointeger(L, 1)) {
-	case 0:
-		interpolateFunc = interpolate::nearestNeighbor;
-		break;
-	case 1:
-		interpolateFunc = interpolate::bilinear;
-		break;
+	int mode = lua_tointeger(L, 1);
+	if (0 <= mode && mode < render::interpolateCount) {
+		interpolateMode = mode;
 	}
 	return 0;
 }
 
-BGRA blendColor(BGRA pd, BGRA ps, Number alpha) {
-	ps.a = static_cast<uint8_t>(ps.a * alpha);
-	int fd, fs;
-	compositeMode(pd, ps, fd, fs);
+int setPremultiplied(lua_State* L) {
+	if (lua_gettop(L) < 1) {
+		return luaL_error(L, "setPremultiplied() require 1 arg");
+	}
 
-	int a = (pd.a * fd + ps.a * fs) / 255;
-	auto px = blendMode(pd, ps);
+	const bool enable = lua_toboolean(L, 1);
+	if (enable != premultiplied) {
+		flushRecorded();
+		premultiplied = enable;
+	}
+	return 0;
+}
 
-	int r = (pd.a * px.r + (255 - pd.a) * ps.r) / 255;
-	int g = (pd.a * px.g + (255 - pd.a) * ps.g) / 255;
-	int b = (pd.a * px.b + (255 - pd.a) * ps.b) / 255;
-	if (a == 0) {
-		r = g = b = 0;
+// smooth edges for the draws that follow
+int setAntialias(lua_State* L) {
+	if (lua_gettop(L) < 1) {
+		return luaL_error(L, "setAntialias() require 1 arg");
+	}
+
+	antialias = lua_toboolean(L, 1);
+	return 0;
+}
+
+// more threads than this only add overhead
+constexpr int maxThreads = 64;
+
+int setThreads(lua_State* L) {
+	if (lua_gettop(L) < 1) {
+		return luaL_error(L, "setThreads() require 1 arg");
+	}
+
+	// the old pool stays when the new one can't start its threads
+	const int threads = static_cast<int>(std::min<lua_Integer>(lua_tointeger(L, 1), maxThreads));
+	bool failed = false;
+	try {
+		pool = std::make_unique<ThreadPool>(threads);
+	}
+	catch (const std::system_error&) {
+		failed = true;
+	}
+	// luaL_error() doesn't return, so it isn't called in the handler
+	if (failed) {
+		return luaL_error(L, "setThreads() can't start %d threads", threads);
+	}
+	return 0;
+}
+
+// converts dest to the format it is drawn in. Bound buffers are read by
+// the caller directly, so they always stay straight.
+void prepareDest(profile::Function function) {
+	profile::Timer timer(function, profile::write);
+	dropPyramid();
+	if (premultiplied && dest->owns()) {
+		dest->premultiply();
 	}
 	else {
-		r = (pd.a * fd * pd.r + ps.a * fs * r) / (a * 255);
-		g = (pd.a * fd * pd.g + ps.a * fs * g) / (a * 255);
-		b = (pd.a * fd * pd.b + ps.a * fs * b) / (a * 255);
+		dest->unpremultiply();
 	}
+}
 
-	BGRA p(
-		static_cast<uint8_t>(b),
-		static_cast<uint8_t>(g),
-		static_cast<uint8_t>(r),
-		static_cast<uint8_t>(a)
-	);
-	return p;
+// gets the mip pyramid of src when it may be minified with mode 2, cached
+// by its buffer or, for a canvas, until the canvas is written
+std::function<std::shared_ptr<const mipmap::Pyramid>()> pyramidOf(
+	const ReadOnlyImage& src, Number zoom, const Image* canvas = nullptr)
+{
+	if (interpolateMode != interpolate::mipmapMode || !(zoom < 1)) return nullptr;
+	return [=] {
+		if (!canvas) return mipmap::cached(src);
+		auto& p = canvasPyramids[canvas];
+		if (!p) p = std::make_shared<const mipmap::Pyramid>(src);
+		return p;
+	};
+}
+
+// draws src with the optional ox,oy,zoom,alpha,rotate args from index arg
+int drawImage(lua_State* L, const ReadOnlyImage& src, int arg, const Image* canvas = nullptr) {
+	const profile::Function function = canvas ? profile::drawCanvas : profile::draw;
+	profile::count(function);
+	const int argn = lua_gettop(L);
+	const int ox = (argn >= arg) ? lua_tointeger(L, arg) : 0;
+	const int oy = (argn >= arg + 1) ? lua_tointeger(L, arg + 1) : 0;
+	Number zoom = static_cast<Number>((argn >= arg + 2) ? lua_tonumber(L, arg + 2) : 1);
+	Number alpha = static_cast<Number>((argn >= arg + 3) ? lua_tonumber(L, arg + 3) : 1);
+	Number rotate = static_cast<Number>((argn >= arg + 4) ? lua_tonumber(L, arg + 4) : 0);
+
+	if (zoom < 0) return 0;
+	alpha = std::clamp(alpha, static_cast<Number>(0), static_cast<Number>(1));
+	rotate = rotate / 180 * std::numbers::pi;
+
+	prepareDest(function);
+	const batch::Command cmd = [&] {
+		profile::Timer timer(function, profile::setup);
+		const render::Pipeline pipeline(compositeMode, blendMode, interpolateMode, alpha, dest->premultiplied);
+		batch::Command c(*dest, src, pipeline, interpolateMode, ox, oy, zoom, rotate, pyramidOf(src, zoom, canvas));
+		c.function = function;
+		if (antialias) c.antialias(*dest);
+		return c;
+	}();
+	submit(cmd);
+	return 0;
 }
 
 // draw(data,w,h, ox,oy,zoom,alpha,rotate)
 int draw(lua_State* L) {
-	const int argn = lua_gettop(L);
-	if (argn < 3) {
+	if (lua_gettop(L) < 3) {
 		return luaL_error(L, "draw() require 3 args");
 	}
 
@@ -175,55 +429,97 @@ int draw(lua_State* L) {
 		lua_tointeger(L, 2),
 		lua_tointeger(L, 3)
 	);
-	const int ox = (argn >= 4) ? lua_tointeger(L, 4) : 0;
-	const int oy = (argn >= 5) ? lua_tointeger(L, 5) : 0;
-	Number zoom = static_cast<Number>((argn >= 6) ? lua_tonumber(L, 6) : 1);
-	Number alpha = static_cast<Number>((argn >= 7) ? lua_tonumber(L, 7) : 1);
-	Number rotate = static_cast<Number>((argn >= 8) ? lua_tonumber(L, 8) : 0);
+	return drawImage(L, src, 4);
+}
 
-	if (zoom < 0) return 0;
-	alpha = std::clamp(alpha, static_cast<Number>(0), static_cast<Number>(1));
-	rotate = rotate / 180 * std::numbers::pi;
+// drawCanvas(id, ox,oy,zoom,alpha,rotate)
+int drawCanvas(lua_State* L) {
+	if (lua_gettop(L) < 1) {
+		return luaL_error(L, "drawCanvas() require 1 arg");
+	}
 
-	Mat<Number> mat;
-	mat.translate(-src.width * 0.5, -src.height * 0.5);
-	mat.scale(zoom, zoom);
-	mat.rotate(rotate);
-	mat.translate(dest.width * 0.5 + ox, dest.height * 0.5 + oy);
-	Mat<Number> inv = mat.inverse();
-
-	Vec2<Number> pts[4] = {
-		mat.transform(Vec2<Number>{ 0,0 }),
-		mat.transform(Vec2<Number>{ static_cast<Number>(src.width),0 }),
-		mat.transform(Vec2<Number>{ static_cast<Number>(src.width),static_cast<Number>(src.height) }),
-		mat.transform(Vec2<Number>{ 0,static_cast<Number>(src.height) }),
-	};
-	int sx = pts[0].x, sy = pts[0].y;
-	int ex = sx, ey = sy;
-	for (int i = 1; i < 4; i++) {
-		if (pts[i].x < sx) sx = pts[i].x;
-		else if (pts[i].x > ex) ex = pts[i].x;
-
-		if (pts[i].y < sy) sy = pts[i].y;
-		else if (pts[i].y > ey) ey = pts[i].y;
-	}
-
-	if (sx < 0) sx = 0;
-	if (ex >= dest.width) ex = dest.width;
-	if (sy < 0) sy = 0;
-	if (ey >= dest.height) ey = dest.height;
-
-	for (int y = sy; y < ey; y++) {
-		for (int x = sx; x < ex; x++) {
-			Vec2<Number> point = inv.transform(Vec2<Number>{
-				static_cast<Number>(x), static_cast<Number>(y) });
-			auto ps = interpolateFunc(src, point);
-			auto pd = dest.getPixel(x, y);
-			auto p = blendColor(pd, ps, alpha);
-			dest.setPixel(x, y, p);
+	auto it = canvases.find(luaL_checkstring(L, 1));
+	if (it == canvases.end()) return 0;
+	if (&it->second == dest) {
+		return luaL_error(L, "drawCanvas() can't draw the selected canvas onto itself");
+	}
+
+	// sampled straight like any other source
+	Image& canvas = it->second;
+	canvas.unpremultiply();
+	return drawImage(L, ReadOnlyImage(canvas.pixels, canvas.width, canvas.height), 2, &canvas);
+}
+
+// drawBatch({{data,w,h, ox,oy,zoom,alpha,rotate, blend=,composite=}, ...})
+// Same result as calling draw() for each entry in order.
+int drawBatch(lua_State* L) {
+	if (lua_gettop(L) < 1 || !lua_istable(L, 1)) {
+		return luaL_error(L, "drawBatch() require a table");
+	}
+	profile::count(profile::drawBatch);
+
+	prepareDest(profile::drawBatch);
+	std::vector<batch::Command> commands;
+	const int n = static_cast<int>(lua_objlen(L, 1));
+	commands.reserve(n);
+	for (int i = 1; i <= n; i++) {
+		lua_rawgeti(L, 1, i);
+		if (!lua_istable(L, -1)) {
+			return luaL_error(L, "drawBatch() entry %d is not a table", i);
+		}
+		for (int k = 1; k <= 8; k++) {
+			lua_rawgeti(L, -k, k);
 		}
+		lua_getfield(L, -9, "blend");
+		lua_getfield(L, -10, "composite");
+
+		// entry at -11, fields 1..8 at -10..-3, blend at -2, composite at -1
+		const ReadOnlyImage src(
+			static_cast<BGRA*>(lua_touserdata(L, -10)),
+			lua_tointeger(L, -9),
+			lua_tointeger(L, -8)
+		);
+		const int ox = lua_tointeger(L, -7);
+		const int oy = lua_tointeger(L, -6);
+		Number zoom = static_cast<Number>(lua_isnil(L, -5) ? 1 : lua_tonumber(L, -5));
+		Number alpha = static_cast<Number>(lua_isnil(L, -4) ? 1 : lua_tonumber(L, -4));
+		Number rotate = static_cast<Number>(lua_tonumber(L, -3));
+
+		int blend = blendMode;
+		if (lua_isnumber(L, -2)) {
+			blend = blend::toMode(lua_tointeger(L, -2));
+		}
+		else if (lua_isstring(L, -2)) {
+			blend = blend::toMode(lua_tostring(L, -2));
+		}
+		int composite = compositeMode;
+		if (lua_isnumber(L, -1)) {
+			int mode = lua_tointeger(L, -1);
+			if (0 <= mode && mode < render::compositeCount) {
+				composite = mode;
+			}
+		}
+		lua_pop(L, 11);
+
+		if (!src.data || zoom < 0) continue;
+		alpha = std::clamp(alpha, static_cast<Number>(0), static_cast<Number>(1));
+		rotate = rotate / 180 * std::numbers::pi;
+
+		profile::Timer timer(profile::drawBatch, profile::setup);
+		const render::Pipeline pipeline(composite, blend, interpolateMode, alpha, dest->premultiplied);
+		commands.emplace_back(*dest, src, pipeline, interpolateMode, ox, oy, zoom, rotate, pyramidOf(src, zoom));
+		commands.back().function = profile::drawBatch;
+		if (antialias) commands.back().antialias(*dest);
 	}
 
+	if (recording) {
+		for (const auto& cmd : commands) {
+			submit(cmd);
+		}
+	}
+	else {
+		drawTiles(commands);
+	}
 	return 0;
 }
 
@@ -233,6 +529,7 @@ int drawPerspective(lua_State* L) {
 	if (argn < 19) {
 		return luaL_error(L, "drawPerspective() require 19 args");
 	}
+	profile::count(profile::drawPerspective);
 
 	const ReadOnlyImage src(
 		static_cast<BGRA*>(lua_touserdata(L, 1)),
@@ -240,10 +537,10 @@ int drawPerspective(lua_State* L) {
 		lua_tointeger(L, 3)
 	);
 	Vec2<Number> xy[4] = {
-		{lua_tonumber(L, 4) + dest.width / 2, lua_tonumber(L, 5) + dest.height / 2},
-		{lua_tonumber(L, 6) + dest.width / 2, lua_tonumber(L, 7) + dest.height / 2},
-		{lua_tonumber(L, 8) + dest.width / 2, lua_tonumber(L, 9) + dest.height / 2},
-		{lua_tonumber(L, 10) + dest.width / 2, lua_tonumber(L, 11) + dest.height / 2},
+		{lua_tonumber(L, 4) + dest->width / 2, lua_tonumber(L, 5) + dest->height / 2},
+		{lua_tonumber(L, 6) + dest->width / 2, lua_tonumber(L, 7) + dest->height / 2},
+		{lua_tonumber(L, 8) + dest->width / 2, lua_tonumber(L, 9) + dest->height / 2},
+		{lua_tonumber(L, 10) + dest->width / 2, lua_tonumber(L, 11) + dest->height / 2},
 	};
 	Vec2<Number> uv[4] = {
 		{lua_tonumber(L, 12), lua_tonumber(L, 13)},
@@ -253,57 +550,279 @@ int drawPerspective(lua_State* L) {
 	};
 	Number alpha = static_cast<Number>((argn >= 20) ? lua_tonumber(L, 20) : 1);
 	
-	Mat<double> mat;
-	getPerspective(uv, xy, mat);
-
-	int sx = xy[0].x, sy = xy[0].y;
-	int ex = sx, ey = sy;
-	for (int i = 1; i < 4; i++) {
-		if (xy[i].x < sx) sx = xy[i].x;
-		else if (xy[i].x > ex) ex = xy[i].x;
-
-		if (xy[i].y < sy) sy = xy[i].y;
-		else if (xy[i].y > ey) ey = xy[i].y;
-	}
-	if (sx < 0) sx = 0;
-	if (ex >= dest.width) ex = dest.width;
-	if (sy < 0) sy = 0;
-	if (ey >= dest.height) ey = dest.height;
-
-	for (int y = sy; y < ey; y++) {
-		for (int x = sx; x < ex; x++) {
-			Vec2<Number> pt{ static_cast<Number>(x), static_cast<Number>(y) };
-			if (cross(xy[0], pt, xy[1]) < 0
-				&& cross(xy[1], pt, xy[2]) < 0
-				&& cross(xy[2], pt, xy[3]) < 0
-				&& cross(xy[3], pt, xy[0]) < 0)
-			{
-				Vec2<Number> point = mat.mapPerspective(pt);
-				auto ps = interpolateFunc(src, point);
-				auto pd = dest.getPixel(x, y);
-				auto p = blendColor(pd, ps, alpha);
-				dest.setPixel(x, y, p);
-			}
-		}
+	prepareDest(profile::drawPerspective);
+	const batch::Command cmd = [&] {
+		profile::Timer timer(profile::drawPerspective, profile::setup);
+		Mat<double> mat;
+		getPerspective(uv, xy, mat);
+		const render::Pipeline pipeline(compositeMode, blendMode, interpolateMode, alpha, dest->premultiplied);
+		batch::Command c(*dest, src, pipeline, mat, xy);
+		c.function = profile::drawPerspective;
+		if (antialias) c.antialias(*dest);
+		return c;
+	}();
+	submit(cmd);
+	return 0;
+}
+
+// x,y relative to the center of dest, as draw() places images, in the
+// coordinates of the rasterizer, where pixel centers are integers
+Vec2<Number> shapePoint(Number x, Number y) {
+	return Vec2<Number>{ x + dest->width / 2 - 0.5, y + dest->height / 2 - 0.5 };
+}
+
+BGRA colorOf(lua_State* L, int index, Number alpha) {
+	const uint32_t rgb = lua_isnumber(L, index) ? static_cast<uint32_t>(lua_tointeger(L, index)) : 0xffffff;
+	return BGRA(
+		static_cast<uint8_t>(rgb),
+		static_cast<uint8_t>(rgb >> 8),
+		static_cast<uint8_t>(rgb >> 16),
+		static_cast<uint8_t>(std::clamp(alpha, static_cast<Number>(0), static_cast<Number>(1)) * 255 + 0.5));
+}
+
+Number numberField(lua_State* L, int index, const char* name, Number fallback) {
+	lua_getfield(L, index, name);
+	const Number v = lua_isnumber(L, -1) ? static_cast<Number>(lua_tonumber(L, -1)) : fallback;
+	lua_pop(L, 1);
+	return v;
+}
+
+// the color argument of the fill functions: 0xRRGGBB (white when nil), or
+// {type="linear", x0=,y0=,x1=,y1=, color0=,color1=, alpha0=,alpha1=}
+// or {type="radial", x=,y=,radius=, color0=,color1=, alpha0=,alpha1=}
+shape::Paint paintOf(lua_State* L, int index) {
+	shape::Paint paint;
+	if (!lua_istable(L, index)) {
+		paint.color0 = colorOf(L, index, 1);
+		return paint;
+	}
+
+	lua_getfield(L, index, "color0");
+	paint.color0 = colorOf(L, -1, numberField(L, index, "alpha0", 1));
+	lua_getfield(L, index, "color1");
+	paint.color1 = colorOf(L, -1, numberField(L, index, "alpha1", 1));
+	lua_getfield(L, index, "type");
+	const std::string type = lua_isstring(L, -1) ? lua_tostring(L, -1) : "";
+	lua_pop(L, 3);
+
+	if (type == "linear") {
+		paint.type = shape::Paint::linear;
+		paint.p0 = shapePoint(numberField(L, index, "x0", 0), numberField(L, index, "y0", 0));
+		paint.p1 = shapePoint(numberField(L, index, "x1", 0), numberField(L, index, "y1", 0));
+	}
+	else if (type == "radial") {
+		paint.type = shape::Paint::radial;
+		paint.p0 = shapePoint(numberField(L, index, "x", 0), numberField(L, index, "y", 0));
+		paint.radius = numberField(L, index, "radius", 0);
 	}
+	return paint;
+}
 
+// paints s with the color argument at index and the optional alpha after it
+int fillShape(lua_State* L, shape::Shape& s, int index) {
+	profile::count(profile::fillShape);
+	const shape::Paint paint = paintOf(L, index);
+	Number alpha = static_cast<Number>((lua_gettop(L) > index) ? lua_tonumber(L, index + 1) : 1);
+	alpha = std::clamp(alpha, static_cast<Number>(0), static_cast<Number>(1));
+
+	flushRecorded();
+	if (antialias) s.antialias();
+	const Rect b = s.bounds(dest->bounds());
+	if (b.empty()) return 0;
+
+	prepareDest(profile::fillShape);
+	dest->markDirty(b);
+	const render::Pipeline pipeline(compositeMode, blendMode, interpolateMode, alpha, dest->premultiplied);
+	forEachBand(b.top, b.bottom, [&](int y0, int y1) {
+		shape::draw(*dest, pipeline, s, paint, Rect(b.left, y0, b.right, y1));
+	});
 	return 0;
 }
 
+// fillRect(x,y,w,h [,color,alpha])
+int fillRect(lua_State* L) {
+	if (lua_gettop(L) < 4) {
+		return luaL_error(L, "fillRect() require 4 args");
+	}
+
+	const Number x = lua_tonumber(L, 1), y = lua_tonumber(L, 2);
+	const Number w = lua_tonumber(L, 3), h = lua_tonumber(L, 4);
+	const Vec2<Number> pts[4] = {
+		shapePoint(x, y), shapePoint(x + w, y), shapePoint(x + w, y + h), shapePoint(x, y + h),
+	};
+	shape::Shape s = shape::Shape::polygon(pts, 4);
+	return fillShape(L, s, 5);
+}
+
+// fillPolygon({x0,y0, x1,y1, ...} [,color,alpha])
+int fillPolygon(lua_State* L) {
+	if (lua_gettop(L) < 1 || !lua_istable(L, 1)) {
+		return luaL_error(L, "fillPolygon() require a table");
+	}
+
+	const int n = static_cast<int>(lua_objlen(L, 1)) / 2;
+	if (n > raster::maxPolygonPoints) {
+		return luaL_error(L, "fillPolygon() takes up to %d points", raster::maxPolygonPoints);
+	}
+	Vec2<Number> pts[raster::maxPolygonPoints];
+	for (int i = 0; i < n; i++) {
+		lua_rawgeti(L, 1, i * 2 + 1);
+		lua_rawgeti(L, 1, i * 2 + 2);
+		pts[i] = shapePoint(lua_tonumber(L, -2), lua_tonumber(L, -1));
+		lua_pop(L, 2);
+	}
+	shape::Shape s = shape::Shape::polygon(pts, n);
+	return fillShape(L, s, 2);
+}
+
+// fillCircle(x,y,r [,color,alpha])
+int fillCircle(lua_State* L) {
+	if (lua_gettop(L) < 3) {
+		return luaL_error(L, "fillCircle() require 3 args");
+	}
+
+	shape::Shape s = shape::Shape::circle(shapePoint(lua_tonumber(L, 1), lua_tonumber(L, 2)), lua_tonumber(L, 3));
+	return fillShape(L, s, 4);
+}
+
+// records the draw calls until flush() and draws them together, tile by
+// tile. Each starts a frame for the pyramid cache.
+int begin(lua_State*) {
+	mipmap::clearCache();
+	recording = true;
+	return 0;
+}
+
+int flush(lua_State*) {
+	flushRecorded();
+	mipmap::clearCache();
+	recording = false;
+	return 0;
+}
+
+// invalidate([data]): drops the cached pyramid of the buffer data, or all
+// of them, after rewriting it between draws in the same frame
+int invalidate(lua_State* L) {
+	if (lua_gettop(L) >= 1 && !lua_isnil(L, 1)) {
+		mipmap::invalidate(static_cast<const BGRA*>(lua_touserdata(L, 1)));
+	}
+	else {
+		mipmap::clearCache();
+	}
+	return 0;
+}
+
+// counters kept from now on; off, they stay as they are
+int setProfiling(lua_State* L) {
+	if (lua_gettop(L) < 1) {
+		return luaL_error(L, "setProfiling() require 1 arg");
+	}
+
+	profile::setEnabled(lua_toboolean(L, 1));
+	return 0;
+}
+
+int resetStats(lua_State*) {
+	profile::reset();
+	return 0;
+}
+
+// {enabled=, draw={calls=, visited=, covered=, setup=, sample=, blend=, write=}, ...}
+// with the times in milliseconds
+int stats(lua_State* L) {
+	static const char* functionNames[] = { "draw", "drawcanvas", "drawbatch", "drawperspective", "fillshape", "getimage" };
+	static const char* phaseNames[] = { "setup", "sample", "blend", "write" };
+	static_assert(std::size(functionNames) == profile::functionCount);
+	static_assert(std::size(phaseNames) == profile::phaseCount);
+
+	lua_newtable(L);
+	lua_pushboolean(L, profile::enabled());
+	lua_setfield(L, -2, "enabled");
+	for (int f = 0; f < profile::functionCount; f++) {
+		const auto& c = profile::counters[f];
+		lua_newtable(L);
+		lua_pushnumber(L, static_cast<lua_Number>(c.calls));
+		lua_setfield(L, -2, "calls");
+		lua_pushnumber(L, static_cast<lua_Number>(c.visited));
+		lua_setfield(L, -2, "visited");
+		lua_pushnumber(L, static_cast<lua_Number>(c.covered));
+		lua_setfield(L, -2, "covered");
+		for (int p = 0; p < profile::phaseCount; p++) {
+			lua_pushnumber(L, static_cast<lua_Number>(c.nanoseconds[p]) / 1e6);
+			lua_setfield(L, -2, phaseNames[p]);
+		}
+		lua_setfield(L, -2, functionNames[f]);
+	}
+	return 1;
+}
+
 static luaL_Reg functions[] = {
 	{"version", version},
 	{"clear", clear},
+	{"fill", fillImage},
+	{"blur", blurImage},
 	{"setimage", setImage},
+	{"bindimage", bindImage},
 	{"getimage", getImage},
+	{"getdirty", getDirty},
+	{"select", select},
+	{"freecanvas", freeCanvas},
 	{"setcomposite", setComposite},
 	{"setblend", setBlend},
 	{"setinterpolate", setInterpolate},
+	{"setpremultiplied", setPremultiplied},
+	{"setantialias", setAntialias},
+	{"setthreads", setThreads},
 	{"draw", draw},
+	{"drawcanvas", drawCanvas},
+	{"drawbatch", drawBatch},
 	{"drawperspective", drawPerspective},
+	{"fillrect", fillRect},
+	{"fillpolygon", fillPolygon},
+	{"fillcircle", fillCircle},
+	{"begin", begin},
+	{"flush", flush},
+	{"invalidate", invalidate},
+	{"setprofiling", setProfiling},
+	{"resetstats", resetStats},
+	{"stats", stats},
 	{nullptr, nullptr},
 };
 
-extern "C" __declspec(dllexport) int luaopen_KaroterraDraw(lua_State * L) {
+// joins the worker threads from lua_close, before the DLL is unloaded
+int releasePool(lua_State*) {
+	pool.reset();
+	recording = false;
+	recorded.clear();
+	recordedSources.clear();
+	mipmap::clearCache();
+	canvasPyramids.clear();
+	canvases.clear();
+	dest = &canvases["0"];
+	region.data = PixelBuffer();
+	region.bind(nullptr, 0, 0);
+	Arena::shared().trim();
+	return 0;
+}
+
+#ifdef _WIN32
+#define EXPORT extern "C" __declspec(dllexport)
+#else
+#define EXPORT extern "C" __attribute__((visibility("default")))
+#endif
+
+EXPORT int luaopen_KaroterraDraw(lua_State * L) {
+	if (!pool) {
+		pool = std::make_unique<ThreadPool>();
+
+		lua_newuserdata(L, 1);
+		lua_newtable(L);
+		lua_pushcfunction(L, releasePool);
+		lua_setfield(L, -2, "__gc");
+		lua_setmetatable(L, -2);
+		lua_setfield(L, LUA_REGISTRYINDEX, "KaroterraDraw.pool");
+	}
+
 	luaL_register(L, "KaroterraDraw", functions);
 	return 1;
 }
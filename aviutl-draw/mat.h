@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdint.h>
 #include <cmath>
 
 template<class T>
@@ -7,6 +8,42 @@ struct Vec2 {
 	T x, y;
 };
 
+// Homogeneous coordinates along a row, advanced by one pixel per step().
+// They are evaluated from x = 0 rather than accumulated, so a pixel gets
+// the same coordinates wherever the span containing it starts.
+template<class T>
+struct ScanLine {
+	T u, v, w;
+	T du, dv, dw;
+	T x;
+
+	void step() {
+		x += 1;
+	}
+
+	// result of Mat::transform
+	Vec2<T> point() const {
+		return Vec2<T>{ u + x * du, v + x * dv };
+	}
+
+	// result of Mat::mapPerspective
+	Vec2<T> project() const {
+		T r = 1 / (w + x * dw);
+		return Vec2<T>{ (u + x * du) * r, (v + x * dv) * r };
+	}
+};
+
+// Affine coordinates along a row in 32.32 fixed point.
+struct FixedScanLine {
+	int64_t u, v;
+	int64_t du, dv;
+
+	void step() {
+		u += du;
+		v += dv;
+	}
+};
+
 template<class T>
 class Mat {
 public:
@@ -62,7 +99,7 @@ public:
 		m13 = x; m23 = y;
 	}
 
-	Mat<T> inverse() {
+	Mat<T> inverse() const {
 		T A = m11 * m22 * m33 + m12 * m23 * m32 + m13 * m21 * m32
 			- m13 * m22 * m31 - m12 * m21 * m33 - m11 * m23 * m32;
 		A = 1 / A;
@@ -79,19 +116,56 @@ public:
 		);
 	}
 
-	Vec2<T> transform(Vec2<T> p) {
+	Vec2<T> transform(Vec2<T> p) const {
 		return Vec2<T>{
 			p.x * m11 + p.y * m12 + m13,
 			p.x * m21 + p.y * m22 + m23,
 		};
 	}
 
-	Vec2<T> mapPerspective(Vec2<T> p) {
+	Vec2<T> mapPerspective(Vec2<T> p) const {
 		T x = p.x * m11 + p.y * m12 + m13;
 		T y = p.x * m21 + p.y * m22 + m23;
 		T w = p.x * m31 + p.y * m32 + m33;
 		return Vec2<T>{ x / w, y / w };
 	}
+
+	ScanLine<T> scanLine(T x, T y) const {
+		return ScanLine<T>{
+			y * m12 + m13,
+			y * m22 + m23,
+			y * m32 + m33,
+			m11, m21, m31,
+			x,
+		};
+	}
+
+	// Fixed point version of scanLine() for affine matrices.
+	// Returns false when the row doesn't fit, so the caller can fall back.
+	// The row is anchored at x = 0, so the coordinates of a pixel don't
+	// depend on where the span containing it starts.
+	bool fixedScanLine(int x, T y, int length, FixedScanLine& line) const {
+		const T limit = static_cast<T>(1 << 30);
+		T u0 = y * m12 + m13;
+		T v0 = y * m22 + m23;
+		T u = u0 + x * m11;
+		T v = v0 + x * m21;
+		T ue = u + m11 * length;
+		T ve = v + m21 * length;
+		if (!(std::abs(u0) < limit && std::abs(v0) < limit
+			&& std::abs(u) < limit && std::abs(v) < limit
+			&& std::abs(ue) < limit && std::abs(ve) < limit))
+		{
+			return false;
+		}
+
+		const T one = static_cast<T>(1LL << 32);
+		line.du = static_cast<int64_t>(std::floor(m11 * one + static_cast<T>(0.5)));
+		line.dv = static_cast<int64_t>(std::floor(m21 * one + static_cast<T>(0.5)));
+		line.u = static_cast<int64_t>(std::floor(u0 * one)) + line.du * x;
+		line.v = static_cast<int64_t>(std::floor(v0 * one)) + line.dv * x;
+		return true;
+	}
 };
 
 template<class T>
@@ -0,0 +1,130 @@
+#include "mipmap.h"
+#include <algorithm>
+
+namespace {
+	// box filter weighted by alpha, so transparent texels don't bleed color
+	BGRA averageWeighted(BGRA c0, BGRA c1, BGRA c2, BGRA c3, int a) {
+		auto f = [=](int v0, int v1, int v2, int v3) {
+			return static_cast<uint8_t>((v0 * c0.a + v1 * c1.a + v2 * c2.a + v3 * c3.a + a / 2) / a);
+		};
+		return BGRA(
+			f(c0.b, c1.b, c2.b, c3.b),
+			f(c0.g, c1.g, c2.g, c3.g),
+			f(c0.r, c1.r, c2.r, c3.r),
+			static_cast<uint8_t>((a + 2) / 4)
+		);
+	}
+
+	inline BGRA average(BGRA c0, BGRA c1, BGRA c2, BGRA c3) {
+		const int a = c0.a + c1.a + c2.a + c3.a;
+		if (a == 4 * 255) {
+			return BGRA(
+				static_cast<uint8_t>((c0.b + c1.b + c2.b + c3.b + 2) / 4),
+				static_cast<uint8_t>((c0.g + c1.g + c2.g + c3.g + 2) / 4),
+				static_cast<uint8_t>((c0.r + c1.r + c2.r + c3.r + 2) / 4),
+				255
+			);
+		}
+		if (a == 0) return BGRA(0, 0, 0, 0);
+		return averageWeighted(c0, c1, c2, c3, a);
+	}
+
+	void halve(const ReadOnlyImage& src, Image& dest) {
+		dest.clear((src.width + 1) / 2, (src.height + 1) / 2);
+		for (int y = 0; y < dest.height; y++) {
+			const int sy = 2 * y;
+			const bool inside = sy + 1 < src.height;
+			BGRA* out = dest.pixels + dest.width * y;
+			int x = 0;
+			if (inside) {
+				const BGRA* top = src.data + src.width * sy;
+				const BGRA* bottom = top + src.width;
+				const int end = src.width / 2;
+				for (; x < end; x++) {
+					out[x] = average(top[2 * x], top[2 * x + 1], bottom[2 * x], bottom[2 * x + 1]);
+				}
+			}
+			// odd last row or column
+			for (; x < dest.width; x++) {
+				const int sx = 2 * x;
+				out[x] = average(
+					src.getPixelSafe(sx, sy), src.getPixelSafe(sx + 1, sy),
+					src.getPixelSafe(sx, sy + 1), src.getPixelSafe(sx + 1, sy + 1));
+			}
+		}
+	}
+
+	struct Entry {
+		const BGRA* data;
+		int width;
+		int height;
+		uint64_t fingerprint;
+		std::shared_ptr<const mipmap::Pyramid> pyramid;
+	};
+
+	constexpr size_t maxEntries = 16;
+	std::vector<Entry> entries;
+
+	// FNV-1a over up to 1024 pixels spread over the image, enough to notice
+	// that a reused buffer now holds another object without reading all of
+	// a large source for a small draw
+	uint64_t fingerprint(const ReadOnlyImage& src) {
+		const size_t n = static_cast<size_t>(src.width) * src.height;
+		const size_t stride = std::max<size_t>(n / 1024, 1);
+		uint64_t h = 14695981039346656037ull;
+		for (size_t i = 0; i < n; i += stride) {
+			const BGRA c = src.data[i];
+			h = (h ^ (c.b | c.g << 8 | c.r << 16 | static_cast<uint32_t>(c.a) << 24)) * 1099511628211ull;
+		}
+		return h;
+	}
+}
+
+namespace mipmap {
+	int levelCount(int width, int height) {
+		int count = 1;
+		for (int w = width, h = height; w > 1 || h > 1; w = (w + 1) / 2, h = (h + 1) / 2) {
+			count++;
+		}
+		return count;
+	}
+
+	Pyramid::Pyramid(const ReadOnlyImage& src) : base(src) {
+		// reserved so the levels never move while the next one reads them
+		levels.reserve(levelCount(src.width, src.height) - 1);
+
+		ReadOnlyImage prev = src;
+		while (prev.width > 1 || prev.height > 1) {
+			Image& next = levels.emplace_back();
+			halve(prev, next);
+			prev = ReadOnlyImage(next.pixels, next.width, next.height);
+		}
+	}
+
+	std::shared_ptr<const Pyramid> cached(const ReadOnlyImage& src) {
+		const uint64_t h = fingerprint(src);
+		for (auto& e : entries) {
+			if (e.data == src.data && e.width == src.width && e.height == src.height) {
+				if (e.fingerprint != h) {
+					e.fingerprint = h;
+					e.pyramid = std::make_shared<Pyramid>(src);
+				}
+				return e.pyramid;
+			}
+		}
+
+		if (entries.size() >= maxEntries) {
+			entries.erase(entries.begin());
+		}
+		entries.push_back(Entry{ src.data, src.width, src.height, h, std::make_shared<Pyramid>(src) });
+		return entries.back().pyramid;
+	}
+
+	void invalidate(const BGRA* data) {
+		std::erase_if(entries, [=](const Entry& e) { return e.data == data; });
+	}
+
+	void clearCache() {
+		entries.clear();
+	}
+}
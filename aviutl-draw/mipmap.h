@@ -0,0 +1,48 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "graphic.h"
+
+namespace mipmap
+{
+	// Halved copies of a source down to 1x1. Level 0 is the source itself.
+	// Level k texel i covers level 0 texels [i * 2^k, (i + 1) * 2^k); texels
+	// past the edge count as transparent, like everywhere else.
+	class Pyramid {
+	public:
+		explicit Pyramid(const ReadOnlyImage& src);
+
+		int count() const {
+			return static_cast<int>(levels.size()) + 1;
+		}
+
+		ReadOnlyImage level(int k) const {
+			if (k == 0) return base;
+			const Image& img = levels[k - 1];
+			return ReadOnlyImage(img.pixels, img.width, img.height);
+		}
+
+	private:
+		ReadOnlyImage base;
+		std::vector<Image> levels;
+	};
+
+	// number of levels of a width x height source, the source included
+	int levelCount(int width, int height);
+	// width or height of level k of a source that is size texels across
+	inline int levelSize(int size, int k) {
+		for (; k > 0; k--) size = (size + 1) / 2;
+		return size;
+	}
+
+	// Pyramid of src, reused while src keeps its pointer, size and a hash
+	// of 1024 pixels spread over it, so a hit costs the same for any size.
+	// A buffer rewritten where the samples don't notice is rebuilt only
+	// after invalidate() or clearCache(). The cache is meant to live for
+	// one frame.
+	std::shared_ptr<const Pyramid> cached(const ReadOnlyImage& src);
+	// drops the pyramid of the buffer at data
+	void invalidate(const BGRA* data);
+	void clearCache();
+}
@@ -0,0 +1,22 @@
+#include "profile.h"
+
+namespace profile
+{
+	std::atomic<bool> enabledFlag{ false };
+	Counters counters[functionCount];
+
+	void setEnabled(bool on) {
+		enabledFlag.store(on, std::memory_order_relaxed);
+	}
+
+	void reset() {
+		for (auto& c : counters) {
+			c.calls = 0;
+			c.visited = 0;
+			c.covered = 0;
+			for (auto& t : c.nanoseconds) {
+				t = 0;
+			}
+		}
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+
+// Counters of the Lua functions that draw, updated only while profiling
+// is on; off, each call and each band checks one flag.
+namespace profile
+{
+	enum Function { draw, drawCanvas, drawBatch, drawPerspective, fillShape, getImage, functionCount };
+
+	// setup: building the commands: matrices, footprints, mip pyramids and
+	//        the source copies taken while recording
+	// sample: rasterizing and fetching or filtering source pixels
+	// blend: compositing the sampled spans into the destination
+	// write: converting the destination between straight and premultiplied
+	enum Phase { setup, sample, blend, write, phaseCount };
+
+	// times are summed over the threads that drew
+	struct Counters {
+		std::atomic<int64_t> calls{ 0 };
+		std::atomic<int64_t> visited{ 0 }; // pixels of the clipped bounds
+		std::atomic<int64_t> covered{ 0 }; // pixels blended
+		std::atomic<int64_t> nanoseconds[phaseCount]{};
+	};
+
+	extern std::atomic<bool> enabledFlag;
+	extern Counters counters[functionCount];
+
+	inline bool enabled() {
+		return enabledFlag.load(std::memory_order_relaxed);
+	}
+
+	void setEnabled(bool on);
+	void reset();
+
+	inline int64_t now() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	inline void add(std::atomic<int64_t>& counter, int64_t v) {
+		counter.fetch_add(v, std::memory_order_relaxed);
+	}
+
+	inline void count(Function f) {
+		if (enabled()) add(counters[f].calls, 1);
+	}
+
+	// adds the time until the end of the scope to a phase
+	class Timer {
+	public:
+		Timer(Function f, Phase phase) : f(f), phase(phase), start(enabled() ? now() : -1) {}
+
+		~Timer() {
+			if (start >= 0) add(counters[f].nanoseconds[phase], now() - start);
+		}
+
+		Timer(const Timer&) = delete;
+		Timer& operator=(const Timer&) = delete;
+
+	private:
+		Function f;
+		Phase phase;
+		int64_t start;
+	};
+}
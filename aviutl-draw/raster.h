@@ -0,0 +1,202 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include "mat.h"
+#include "graphic.h"
+
+namespace raster
+{
+	// Rows and columns a polygon can cover inside clip.
+	template<class T>
+	Rect bounds(const Vec2<T>* pts, int n, const Rect& clip) {
+		T minX = pts[0].x, maxX = pts[0].x;
+		T minY = pts[0].y, maxY = pts[0].y;
+		for (int i = 1; i < n; i++) {
+			minX = std::min(minX, pts[i].x);
+			maxX = std::max(maxX, pts[i].x);
+			minY = std::min(minY, pts[i].y);
+			maxY = std::max(maxY, pts[i].y);
+		}
+		if (!(minX <= maxX && minY <= maxY)) return Rect();
+
+		auto lo = [](T v, int limit) {
+			return v <= limit ? limit : static_cast<int>(std::max(std::ceil(v), static_cast<T>(limit)));
+		};
+		auto hi = [](T v, int limit) {
+			return v >= limit ? limit : static_cast<int>(std::min(std::floor(v) + 1, static_cast<T>(limit)));
+		};
+		return Rect(
+			lo(minX, clip.left), lo(minY, clip.top),
+			hi(maxX, clip.right), hi(maxY, clip.bottom)
+		);
+	}
+
+	constexpr int maxPolygonPoints = 32;
+
+	// Calls span(y, x0, x1) with the pixels of each row in clip whose integer
+	// coordinate lies strictly inside the polygon, by the even-odd rule.
+	// Pixels on an edge are left out, as with a cross() < 0 test.
+	template<class T, class F>
+	void scanPolygon(const Vec2<T>* pts, int n, const Rect& clip, F&& span) {
+		constexpr int maxEdges = maxPolygonPoints;
+		if (n < 3 || n > maxEdges) return;
+
+		const Rect r = bounds(pts, n, clip);
+		if (r.empty()) return;
+
+		struct Crossing {
+			T x;
+			int first; // smallest pixel right of the edge
+			int last; // largest pixel left of the edge
+		};
+		Crossing crossings[maxEdges];
+		std::pair<int, int> excluded[maxEdges * 2];
+
+		for (int y = r.top; y < r.bottom; y++) {
+			const T fy = static_cast<T>(y);
+			int count = 0;
+			int excludedCount = 0;
+			for (int i = 0; i < n; i++) {
+				Vec2<T> a = pts[i];
+				Vec2<T> b = pts[(i + 1) % n];
+				if (a.y == fy && b.y == fy) {
+					// horizontal edge on this row
+					T x0 = std::min(a.x, b.x), x1 = std::max(a.x, b.x);
+					excluded[excludedCount++] = std::make_pair(
+						static_cast<int>(std::max(std::ceil(x0), static_cast<T>(r.left - 1))),
+						static_cast<int>(std::min(std::floor(x1), static_cast<T>(r.right))));
+					continue;
+				}
+				if (a.y == fy && a.x == std::floor(a.x) && r.left <= a.x && a.x < r.right) {
+					// a vertex on a pixel is on the boundary too
+					int x = static_cast<int>(a.x);
+					excluded[excludedCount++] = std::make_pair(x, x);
+				}
+				if (!((a.y <= fy && fy < b.y) || (b.y <= fy && fy < a.y))) continue;
+
+				// the sign of cross() decides which side a pixel is on, exactly
+				// as the per-pixel test does; x is only the starting guess
+				const T dir = b.y > a.y ? 1 : -1;
+				auto right = [&](int x) {
+					return cross(a, Vec2<T>{ static_cast<T>(x), fy }, b) * dir > 0;
+				};
+				auto left = [&](int x) {
+					return cross(a, Vec2<T>{ static_cast<T>(x), fy }, b) * dir < 0;
+				};
+				const int lo = r.left - 1, hi = r.right;
+				T x = a.x + (fy - a.y) * (b.x - a.x) / (b.y - a.y);
+				if (!(x >= lo)) x = static_cast<T>(lo);
+				else if (!(x <= hi)) x = static_cast<T>(hi);
+
+				int first = static_cast<int>(std::floor(x));
+				while (first > lo && right(first - 1)) first--;
+				while (first < hi && !right(first)) first++;
+				int last = static_cast<int>(std::ceil(x));
+				while (last < hi && left(last + 1)) last++;
+				while (last > lo && !left(last)) last--;
+
+				crossings[count++] = Crossing{ x, first, last };
+			}
+
+			std::sort(crossings, crossings + count, [](const Crossing& p, const Crossing& q) {
+				return p.x < q.x;
+			});
+			std::sort(excluded, excluded + excludedCount);
+			for (int i = 0; i + 1 < count; i += 2) {
+				int x0 = std::max(crossings[i].first, r.left);
+				int x1 = std::min(crossings[i + 1].last + 1, r.right);
+				// cut out horizontal edges lying on this row
+				for (int j = 0; j < excludedCount && x0 < x1; j++) {
+					int e0 = excluded[j].first, e1 = excluded[j].second + 1;
+					if (e1 <= x0 || x1 <= e0) continue;
+					if (e0 > x0) {
+						span(y, x0, e0);
+					}
+					x0 = e1;
+				}
+				if (x0 < x1) {
+					span(y, x0, x1);
+				}
+			}
+		}
+	}
+
+	// Fraction of each pixel inside a convex polygon, from the signed
+	// distance of the pixel to every edge, so edges are smooth at any angle
+	// without supersampling. Corners multiply the coverage of their edges.
+	class Coverage {
+	public:
+		static constexpr int maxEdges = maxPolygonPoints;
+
+		// false when pts is not convex with an area; the draw stays aliased
+		bool init(const Vec2<double>* pts, int count) {
+			n = 0;
+			if (count < 3 || count > maxEdges) return false;
+			double area = 0;
+			for (int i = 0; i < count; i++) {
+				const Vec2<double> p = pts[i], q = pts[(i + 1) % count];
+				area += p.x * q.y - q.x * p.y;
+			}
+			if (!(std::abs(area) > 0) || !std::isfinite(area)) return false;
+			const double sign = area > 0 ? 1 : -1;
+			for (int i = 0; i < count; i++) {
+				if (!(cross(pts[i], pts[(i + 1) % count], pts[(i + 2) % count]) * sign > 0)) return false;
+			}
+
+			// inside when a * x + b * y + c > 0, a and b a unit normal
+			for (int i = 0; i < count; i++) {
+				const Vec2<double> p = pts[i], q = pts[(i + 1) % count];
+				const double ex = q.x - p.x, ey = q.y - p.y;
+				const double len = std::hypot(ex, ey) * sign;
+				a[i] = -ey / len;
+				b[i] = ex / len;
+				c[i] = -(a[i] * p.x + b[i] * p.y);
+			}
+			n = count;
+			return true;
+		}
+
+		// the polygon grown by half a pixel, outside of which the coverage
+		// is 0; as many corners as the polygon
+		void outline(Vec2<double>* out) const {
+			for (int i = 0; i < n; i++) {
+				const int j = (i + n - 1) % n;
+				// a x + b y = -c - 0.5 for the edges on either side of corner i
+				const double det = a[j] * b[i] - a[i] * b[j];
+				const double cj = -c[j] - 0.5, ci = -c[i] - 0.5;
+				out[i] = Vec2<double>{ (cj * b[i] - ci * b[j]) / det, (a[j] * ci - a[i] * cj) / det };
+			}
+		}
+
+		// scales the alpha of px[i], the pixel (x0 + i, y), by its coverage
+		void apply(int x0, int y, BGRA* px, int count) const {
+			// one less than the coverage of each edge at x0
+			double d[maxEdges];
+			bool inside = true;
+			for (int i = 0; i < n; i++) {
+				d[i] = a[i] * x0 + b[i] * y + c[i] - 0.5;
+				inside = inside && d[i] >= 0 && d[i] + a[i] * (count - 1) >= 0;
+			}
+			if (inside) return;
+
+			for (int k = 0; k < count; k++) {
+				double coverage = 1;
+				for (int i = 0; i < n; i++) {
+					coverage *= std::clamp(d[i] + 1, 0.0, 1.0);
+					d[i] += a[i];
+				}
+				if (coverage < 1) {
+					px[k].a = static_cast<uint8_t>(px[k].a * coverage + 0.5);
+				}
+			}
+		}
+
+	private:
+		int n = 0;
+		double a[maxEdges];
+		double b[maxEdges];
+		double c[maxEdges];
+	};
+}
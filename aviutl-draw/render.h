@@ -0,0 +1,423 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <utility>
+#include "cpu.h"
+#include "fill.h"
+#include "mat.h"
+#include "graphic.h"
+#include "composite.h"
+#include "blend.h"
+#include "blendtable.h"
+#include "interpolate.h"
+#include "raster.h"
+#include "resample.h"
+
+using Number = double;
+
+namespace render
+{
+	// table is blend::table<Blend>(), for the modes that have one
+	template<composite::Composite Composite, blend::Blend Blend>
+	inline BGRA blendColor(BGRA pd, BGRA ps, const blend::Table* table = nullptr) {
+		int fd, fs;
+		Composite(pd, ps, fd, fs);
+
+		int a = (pd.a * fd + ps.a * fs) / 255;
+		auto px = blend::apply<Blend>(pd, ps, table);
+
+		int r = (pd.a * px.r + (255 - pd.a) * ps.r) / 255;
+		int g = (pd.a * px.g + (255 - pd.a) * ps.g) / 255;
+		int b = (pd.a * px.b + (255 - pd.a) * ps.b) / 255;
+		if (a == 0) {
+			r = g = b = 0;
+		}
+		else {
+			r = (pd.a * fd * pd.r + ps.a * fs * r) / (a * 255);
+			g = (pd.a * fd * pd.g + ps.a * fs * g) / (a * 255);
+			b = (pd.a * fd * pd.b + ps.a * fs * b) / (a * 255);
+		}
+
+		return BGRA(
+			static_cast<uint8_t>(b),
+			static_cast<uint8_t>(g),
+			static_cast<uint8_t>(r),
+			static_cast<uint8_t>(a)
+		);
+	}
+
+	// same result as blendColor, premultiplied, without a division by alpha;
+	// pd is premultiplied and ps straight
+	template<composite::Composite Composite, blend::Blend Blend>
+	inline BGRA blendColorPremultiplied(BGRA pd, BGRA ps, const blend::Table* table = nullptr) {
+		int fd, fs;
+		Composite(pd, ps, fd, fs);
+
+		BGRA s;
+		if constexpr (Blend == blend::normal) {
+			s = toPremultiplied(ps);
+		}
+		else {
+			auto px = blend::apply<Blend>(toStraight(pd), ps, table);
+			s = toPremultiplied(BGRA(
+				static_cast<uint8_t>(div255(pd.a * px.b + (255 - pd.a) * ps.b)),
+				static_cast<uint8_t>(div255(pd.a * px.g + (255 - pd.a) * ps.g)),
+				static_cast<uint8_t>(div255(pd.a * px.r + (255 - pd.a) * ps.r)),
+				ps.a
+			));
+		}
+
+		// lighter can exceed 255
+		auto f = [=](int cd, int cs) {
+			return static_cast<uint8_t>(std::min(div255(cd * fd) + div255(cs * fs), 255));
+		};
+		return BGRA(f(pd.b, s.b), f(pd.g, s.g), f(pd.r, s.r), f(pd.a, s.a));
+	}
+
+	// ps.a * alpha for every source alpha, so the loops don't touch floating point
+	struct AlphaTable {
+		uint8_t value[256];
+
+		AlphaTable(Number alpha) {
+			for (int i = 0; i < 256; i++) {
+				value[i] = static_cast<uint8_t>(i * alpha);
+			}
+		}
+	};
+
+	using BlendSpan = void(*)(BGRA* dest, const BGRA* src, int n, const AlphaTable& alpha);
+
+	// composites whose result is dest wherever the source is transparent,
+	// whatever the blend: fd is 255 when src.a is 0
+	template<composite::Composite Composite>
+	constexpr bool keepsDest =
+		Composite == composite::destination || Composite == composite::sourceOver
+		|| Composite == composite::destinationOver || Composite == composite::destinationOut
+		|| Composite == composite::sourceAtop || Composite == composite::exclusiveOR
+		|| Composite == composite::lighter;
+
+	// composites whose result doesn't depend on the source pixels
+	template<composite::Composite Composite>
+	constexpr bool ignoresSource = Composite == composite::clear || Composite == composite::destination;
+
+	// dest as blendColor() returns it when it is kept: straight pixels
+	// without alpha lose their color, premultiplied ones have none
+	template<bool Premultiplied>
+	inline void keep(BGRA& pd) {
+		if constexpr (!Premultiplied) {
+			const uint32_t v = std::bit_cast<uint32_t>(pd);
+			pd = std::bit_cast<BGRA>((v >> 24) ? v : 0u);
+		}
+	}
+
+	// src is always straight, dest premultiplied when Premultiplied is set.
+	// The modes that reduce to a constant, dest or src skip the general
+	// formula, and so do the pixels a transparent or opaque source decides.
+	template<composite::Composite Composite, blend::Blend Blend, bool Premultiplied>
+	void blendSpan(BGRA* dest, const BGRA* src, int n, const AlphaTable& alpha) {
+		if constexpr (Composite == composite::clear) {
+			std::fill_n(dest, n, BGRA(0, 0, 0, 0));
+			return;
+		}
+		else if constexpr (Composite == composite::destination) {
+			// keep() on every pixel, through 32 bit words: GCC doesn't vectorize
+			// the select on BGRA (380 vs 2700+ Mpx/s), so don't inline keep() here
+			if constexpr (!Premultiplied) fill::clearTransparent(dest, n);
+			return;
+		}
+
+		const blend::Table* table = blend::table<Blend>();
+		for (int i = 0; i < n; i++) {
+			BGRA ps = src[i];
+			ps.a = alpha.value[ps.a];
+			if constexpr (keepsDest<Composite>) {
+				if (ps.a == 0) {
+					keep<Premultiplied>(dest[i]);
+					continue;
+				}
+			}
+			if constexpr (Blend == blend::normal && (Composite == composite::copy || Composite == composite::sourceOver)) {
+				// copy writes the source, and so does sourceOver where it is opaque
+				if (Composite == composite::copy || ps.a == 255) {
+					dest[i] = Premultiplied ? toPremultiplied(ps) : ps.a ? ps : BGRA(0, 0, 0, 0);
+					continue;
+				}
+			}
+			if constexpr (Premultiplied) {
+				dest[i] = blendColorPremultiplied<Composite, Blend>(dest[i], ps, table);
+			}
+			else {
+				dest[i] = blendColor<Composite, Blend>(dest[i], ps, table);
+			}
+		}
+	}
+
+	constexpr int compositeCount = static_cast<int>(std::size(composite::modes));
+	constexpr int blendCount = static_cast<int>(std::size(blend::modes));
+	constexpr int interpolateCount = interpolate::modeCount;
+
+	// index = composite * blendCount + blend
+	template<bool Premultiplied, size_t... I>
+	constexpr std::array<BlendSpan, sizeof...(I)> makeBlendTable(std::index_sequence<I...>) {
+		return { &blendSpan<composite::modes[I / blendCount], blend::modes[I % blendCount], Premultiplied>... };
+	}
+
+	constexpr auto blendSpans = makeBlendTable<false>(std::make_index_sequence<compositeCount * blendCount>{});
+	constexpr auto blendSpansPremultiplied = makeBlendTable<true>(std::make_index_sequence<compositeCount * blendCount>{});
+
+	template<size_t... I>
+	constexpr std::array<bool, sizeof...(I)> makeKeepsDest(std::index_sequence<I...>) {
+		return { keepsDest<composite::modes[I]>... };
+	}
+
+	template<size_t... I>
+	constexpr std::array<bool, sizeof...(I)> makeIgnoresSource(std::index_sequence<I...>) {
+		return { ignoresSource<composite::modes[I]>... };
+	}
+
+	constexpr int destinationMode = 2;
+	static_assert(composite::modes[destinationMode] == composite::destination);
+
+	// keepsDest and ignoresSource by composite index
+	constexpr auto compositeKeepsDest = makeKeepsDest(std::make_index_sequence<compositeCount>{});
+	constexpr auto compositeIgnoresSource = makeIgnoresSource(std::make_index_sequence<compositeCount>{});
+
+	// blendSpan<sourceOver, normal, false>; alpha is AlphaTable::value
+	void sourceOverSpanSSE41(BGRA* dest, const BGRA* src, int n, const uint8_t* alpha);
+
+	inline void sourceOverSSE41(BGRA* dest, const BGRA* src, int n, const AlphaTable& alpha) {
+		sourceOverSpanSSE41(dest, src, n, alpha.value);
+	}
+
+	// the blend span of a mode, using SIMD where there is a version for it
+	inline BlendSpan blendSpanOf(int compositeMode, int blendMode, bool premultiplied) {
+#ifdef CPU_X86
+		if (!premultiplied && composite::modes[compositeMode] == composite::sourceOver
+			&& blend::modes[blendMode] == blend::normal && cpu::hasSSE41())
+		{
+			return sourceOverSSE41;
+		}
+#endif
+		return (premultiplied ? blendSpansPremultiplied : blendSpans)[compositeMode * blendCount + blendMode];
+	}
+
+	// everything a draw call needs besides the geometry
+	struct Pipeline {
+		interpolate::Sampler sample;
+		BlendSpan blend;
+		AlphaTable alpha;
+		// edges of the source when antialiasing; set by the command drawing
+		const raster::Coverage* coverage = nullptr;
+		// false when blend doesn't read the source, which then isn't sampled
+		bool readsSource = true;
+
+		// premultiplied is the format of the destination
+		Pipeline(int compositeMode, int blendMode, int interpolateMode, Number opacity, bool premultiplied = false)
+			: sample(interpolate::sampler(interpolateMode))
+			, blend(blendSpanOf(compositeMode, blendMode, premultiplied))
+			, alpha(opacity)
+		{
+			// a source made transparent by the opacity draws as destination
+			if (alpha.value[255] == 0 && compositeKeepsDest[compositeMode]) {
+				compositeMode = destinationMode;
+				blend = blendSpanOf(compositeMode, blendMode, premultiplied);
+			}
+			readsSource = !compositeIgnoresSource[compositeMode];
+		}
+	};
+
+	// pixels are sampled and blended in runs of this length
+	constexpr int spanLength = 64;
+
+	// Keeps the points on the texels when antialiasing, so the samplers
+	// don't fade to the transparent pixels past the edges as well.
+	inline void clampToEdges(const ReadOnlyImage& src, const Pipeline& pipeline, Vec2<int32_t>* pts, int n) {
+		if (!pipeline.coverage) return;
+		const int32_t right = (src.width - 1) * interpolate::fixedOne;
+		const int32_t bottom = (src.height - 1) * interpolate::fixedOne;
+		for (int i = 0; i < n; i++) {
+			pts[i].x = std::clamp(pts[i].x, 0, right);
+			pts[i].y = std::clamp(pts[i].y, 0, bottom);
+		}
+	}
+
+	// blends the sampled pixels px onto row y from x0, faded at the edges
+	// of the source when antialiasing
+	inline void blendRun(Image& dest, const Pipeline& pipeline, int y, int x0, BGRA* px, int n) {
+		if (pipeline.coverage) {
+			pipeline.coverage->apply(x0, y, px, n);
+		}
+		pipeline.blend(dest.pixels + x0 + dest.width * y, px, n, pipeline.alpha);
+	}
+
+	// samples and blends pixels [sx, ex) of row y; next() yields the
+	// 16.16 source coordinate of each pixel in turn
+	template<class Next>
+	inline void drawRow(
+		Image& dest, const ReadOnlyImage& src, const Pipeline& pipeline,
+		int y, int sx, int ex, Next&& next)
+	{
+		Vec2<int32_t> pts[spanLength];
+		BGRA px[spanLength];
+		for (int x0 = sx; x0 < ex; x0 += spanLength) {
+			int n = std::min(spanLength, ex - x0);
+			for (int i = 0; i < n; i++) {
+				pts[i] = next();
+			}
+			clampToEdges(src, pipeline, pts, n);
+			pipeline.sample(src, pts, px, n);
+			blendRun(dest, pipeline, y, x0, px, n);
+		}
+	}
+
+	// blends the pixels of clip inside quad with a pipeline that doesn't
+	// read the source
+	inline void drawFootprint(Image& dest, const Pipeline& pipeline, const Vec2<Number> quad[4], const Rect& clip) {
+		raster::scanPolygon(quad, 4, clip, [&](int y, int x0, int x1) {
+			pipeline.blend(dest.pixels + x0 + dest.width * y, nullptr, x1 - x0, pipeline.alpha);
+		});
+	}
+
+	// draws the pixels of clip inside quad, the destination footprint of src
+	inline void drawAffine(
+		Image& dest, const ReadOnlyImage& src, const Pipeline& pipeline, const Mat<Number>& inv,
+		const Vec2<Number> quad[4], const Rect& clip)
+	{
+		raster::scanPolygon(quad, 4, clip, [&](int y, int x0, int x1) {
+			FixedScanLine fixed;
+			if (inv.fixedScanLine(x0, y, x1 - x0, fixed)) {
+				drawRow(dest, src, pipeline, y, x0, x1, [&] {
+					auto p = interpolate::toFixed(src, fixed);
+					fixed.step();
+					return p;
+				});
+			}
+			else {
+				auto line = inv.scanLine(x0, y);
+				drawRow(dest, src, pipeline, y, x0, x1, [&] {
+					auto p = interpolate::toFixed(src, line.point());
+					line.step();
+					return p;
+				});
+			}
+		});
+	}
+
+	// draws where every destination pixel falls exactly on the source texel
+	// (x * step + offset.x, y * step + offset.y), which all samplers return
+	// unchanged; rows inside src are blended straight from its pixels
+	inline void drawAligned(
+		Image& dest, const ReadOnlyImage& src, const Pipeline& pipeline, int step, Vec2<int> offset,
+		bool nearest, const Vec2<Number> quad[4], const Rect& clip)
+	{
+		// nearestNeighborSpan rounds -0.5 toward zero, onto texel 0
+		auto texel = [=](int c) {
+			return nearest && c == -1 ? 0 : c;
+		};
+		raster::scanPolygon(quad, 4, clip, [&](int y, int sx, int ex) {
+			BGRA* row = dest.pixels + dest.width * y;
+			const int ty = texel(y * step + offset.y);
+			auto gather = [&](int x0, int x1) {
+				BGRA px[spanLength];
+				for (int c0 = x0; c0 < x1; c0 += spanLength) {
+					int n = std::min(spanLength, x1 - c0);
+					for (int i = 0; i < n; i++) {
+						px[i] = src.getPixelSafe(texel((c0 + i) * step + offset.x), ty);
+					}
+					pipeline.blend(row + c0, px, n, pipeline.alpha);
+				}
+			};
+
+			if (step != 1 || ty < 0 || src.height <= ty) {
+				gather(sx, ex);
+				return;
+			}
+			const int first = std::clamp(-offset.x, sx, ex);
+			const int last = std::clamp(src.width - offset.x, first, ex);
+			gather(sx, first);
+			pipeline.blend(row + first, src.data + first + offset.x + src.width * ty, last - first, pipeline.alpha);
+			gather(last, ex);
+		});
+	}
+
+	// trilinear filtering: levels[0] and levels[1] are sampled and mixed by
+	// weight / 256, inv[i] maps the destination onto levels[i]
+	inline void drawAffineMip(
+		Image& dest, const ReadOnlyImage levels[2], const Pipeline& pipeline, const Mat<Number> inv[2],
+		int weight, const Vec2<Number> quad[4], const Rect& clip)
+	{
+		raster::scanPolygon(quad, 4, clip, [&](int y, int sx, int ex) {
+			FixedScanLine fixed[2];
+			ScanLine<Number> line[2];
+			bool isFixed[2];
+			for (int l = 0; l < 2; l++) {
+				isFixed[l] = inv[l].fixedScanLine(sx, y, ex - sx, fixed[l]);
+				line[l] = inv[l].scanLine(sx, y);
+			}
+
+			Vec2<int32_t> pts[spanLength];
+			BGRA px[2][spanLength];
+			for (int x0 = sx; x0 < ex; x0 += spanLength) {
+				int n = std::min(spanLength, ex - x0);
+				for (int l = 0; l < 2; l++) {
+					for (int i = 0; i < n; i++) {
+						if (isFixed[l]) {
+							pts[i] = interpolate::toFixed(levels[l], fixed[l]);
+							fixed[l].step();
+						}
+						else {
+							pts[i] = interpolate::toFixed(levels[l], line[l].point());
+							line[l].step();
+						}
+					}
+					clampToEdges(levels[l], pipeline, pts, n);
+					pipeline.sample(levels[l], pts, px[l], n);
+				}
+				for (int i = 0; i < n; i++) {
+					auto mix = [=](int c0, int c1) {
+						return static_cast<uint8_t>(c0 + (((c1 - c0) * weight + 128) >> 8));
+					};
+					const BGRA c0 = px[0][i], c1 = px[1][i];
+					px[0][i] = BGRA(mix(c0.b, c1.b), mix(c0.g, c1.g), mix(c0.r, c1.r), mix(c0.a, c1.a));
+				}
+				blendRun(dest, pipeline, y, x0, px[0], n);
+			}
+		});
+	}
+
+	// axis-aligned draws (inv without rotation, positive scale) with a
+	// resampling kernel: columns and rows hold the taps of every destination
+	// column and row from columnBase and rowBase, computed once per draw,
+	// and each row is filtered separably instead of gathered per pixel
+	inline void drawSeparable(
+		Image& dest, const ReadOnlyImage& src, const Pipeline& pipeline, const resample::Kernel& kernel,
+		const resample::Taps* columns, int columnBase, const resample::Taps* rows, int rowBase,
+		const Vec2<Number> quad[4], const Rect& clip)
+	{
+		BGRA px[spanLength];
+		raster::scanPolygon(quad, 4, clip, [&](int y, int sx, int ex) {
+			for (int x0 = sx; x0 < ex; x0 += spanLength) {
+				int n = std::min(spanLength, ex - x0);
+				resample::separableRow(src, kernel, rows[y - rowBase], columns, columnBase, x0, x0 + n, px);
+				blendRun(dest, pipeline, y, x0, px, n);
+			}
+		});
+	}
+
+	inline void drawPerspective(
+		Image& dest, const ReadOnlyImage& src, const Pipeline& pipeline, const Mat<Number>& mat,
+		const Vec2<Number> quad[4], const Rect& clip)
+	{
+		raster::scanPolygon(quad, 4, clip, [&](int y, int x0, int x1) {
+			auto line = mat.scanLine(x0, y);
+			drawRow(dest, src, pipeline, y, x0, x1, [&] {
+				auto p = interpolate::toFixed(src, line.project());
+				line.step();
+				return p;
+			});
+		});
+	}
+}
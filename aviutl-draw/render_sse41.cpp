@@ -0,0 +1,87 @@
+#include "graphic.h"
+#include "cpu.h"
+#include <string.h>
+
+#ifdef CPU_X86
+#include <smmintrin.h>
+
+// Nothing inline from the headers is used here, not even BGRA's
+// constructors or std::copy: copies compiled with these instructions
+// could be the ones the linker keeps. render.h isn't included, since it
+// instantiates every blend span.
+namespace {
+	inline __m128i channel(__m128i px, int shift) {
+		return _mm_and_si128(_mm_srli_epi32(px, shift), _mm_set1_epi32(0xff));
+	}
+
+	// v / 255 truncated, exact for 0 <= v <= 255 * 255
+	inline __m128i div255(__m128i v) {
+		return _mm_srli_epi32(_mm_mullo_epi32(_mm_add_epi32(v, _mm_set1_epi32(1)), _mm_set1_epi32(257)), 16);
+	}
+
+	// render::blendColor<sourceOver, normal> of 4 pixels. The color
+	// numerator stays below 2^24, so a float division truncates to the
+	// same quotient as the integer one.
+	inline __m128i sourceOver(__m128i d, __m128i s, __m128i sa) {
+		const __m128i da = _mm_srli_epi32(d, 24);
+		const __m128i wd = _mm_mullo_epi32(da, _mm_sub_epi32(_mm_set1_epi32(255), sa));
+		const __m128i ws = _mm_mullo_epi32(sa, _mm_set1_epi32(255));
+		const __m128i a = div255(_mm_add_epi32(wd, ws));
+
+		const __m128 denominator = _mm_cvtepi32_ps(_mm_mullo_epi32(a, _mm_set1_epi32(255)));
+		const __m128i nonzero = _mm_xor_si128(_mm_cmpeq_epi32(a, _mm_setzero_si128()), _mm_set1_epi32(-1));
+		auto mix = [&](int shift) {
+			const __m128i v = _mm_add_epi32(
+				_mm_mullo_epi32(wd, channel(d, shift)),
+				_mm_mullo_epi32(ws, channel(s, shift)));
+			const __m128i q = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(v), denominator));
+			// the color can reach 256 and wraps like the uint8_t cast
+			return _mm_slli_epi32(_mm_and_si128(_mm_and_si128(q, nonzero), _mm_set1_epi32(0xff)), shift);
+		};
+		return _mm_or_si128(
+			_mm_or_si128(mix(0), mix(8)),
+			_mm_or_si128(mix(16), _mm_slli_epi32(a, 24)));
+	}
+
+	// dest and src are 4 pixels as bytes, so the tail can be blended from
+	// a copy without constructing or copying BGRA
+	inline void blend4(uint8_t* dest, const uint8_t* src, const uint8_t* alpha) {
+		const __m128i sa = _mm_setr_epi32(alpha[src[3]], alpha[src[7]], alpha[src[11]], alpha[src[15]]);
+		const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+		const __m128i opaque = _mm_cmpeq_epi32(sa, _mm_set1_epi32(255));
+		if (_mm_movemask_ps(_mm_castsi128_ps(opaque)) == 0xf) {
+			// the result is the source with full alpha
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dest), _mm_or_si128(s, _mm_set1_epi32(0xff000000)));
+			return;
+		}
+		const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dest));
+		const __m128i transparent = _mm_cmpeq_epi32(sa, _mm_setzero_si128());
+		if (_mm_movemask_ps(_mm_castsi128_ps(transparent)) == 0xf) {
+			// the result is dest, without the colors of its transparent pixels
+			const __m128i empty = _mm_cmpeq_epi32(_mm_srli_epi32(d, 24), _mm_setzero_si128());
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dest), _mm_andnot_si128(empty, d));
+			return;
+		}
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dest), sourceOver(d, s, sa));
+	}
+}
+
+namespace render {
+	void sourceOverSpanSSE41(BGRA* dest, const BGRA* src, int n, const uint8_t* alpha) {
+		uint8_t* d = reinterpret_cast<uint8_t*>(dest);
+		const uint8_t* s = reinterpret_cast<const uint8_t*>(src);
+		int i = 0;
+		for (; i + 4 <= n; i += 4) {
+			blend4(d + 4 * i, s + 4 * i, alpha);
+		}
+		if (i < n) {
+			const size_t bytes = 4 * static_cast<size_t>(n - i);
+			uint8_t dt[16] = {}, st[16] = {};
+			memcpy(dt, d + 4 * i, bytes);
+			memcpy(st, s + 4 * i, bytes);
+			blend4(dt, st, alpha);
+			memcpy(d + 4 * i, dt, bytes);
+		}
+	}
+}
+#endif
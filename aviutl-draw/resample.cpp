@@ -0,0 +1,165 @@
+#include "resample.h"
+#include "interpolate.h"
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+using namespace resample;
+using interpolate::fixedShift;
+using interpolate::fixedOne;
+
+namespace {
+	// Keys cubic with a = -0.5 (Catmull-Rom)
+	double cubic(double x) {
+		x = std::abs(x);
+		if (x < 1) return (1.5 * x - 2.5) * x * x + 1;
+		if (x < 2) return ((-0.5 * x + 2.5) * x - 4) * x + 2;
+		return 0;
+	}
+
+	double sinc(double x) {
+		if (x == 0) return 1;
+		x *= std::numbers::pi;
+		return std::sin(x) / x;
+	}
+
+	double lanczos3(double x) {
+		return std::abs(x) < 3 ? sinc(x) * sinc(x / 3) : 0;
+	}
+
+	template<class F>
+	Kernel makeKernel(int taps, F&& f) {
+		Kernel k{ taps, {} };
+		const int center = taps / 2 - 1;
+		for (int p = 0; p < phases; p++) {
+			const double t = static_cast<double>(p) / phases;
+			double w[maxTaps];
+			double sum = 0;
+			for (int i = 0; i < taps; i++) {
+				w[i] = f(i - center - t);
+				sum += w[i];
+			}
+			// rounding error goes to the nearest tap so every row sums to 1
+			int total = 0;
+			for (int i = 0; i < taps; i++) {
+				k.weights[p][i] = static_cast<int16_t>(std::lround(w[i] / sum * 16384));
+				total += k.weights[p][i];
+			}
+			k.weights[p][t < 0.5 ? center : center + 1] += static_cast<int16_t>(16384 - total);
+		}
+		return k;
+	}
+
+	inline uint8_t toChannel(int v) {
+		return static_cast<uint8_t>(std::clamp((v + (1 << 20)) >> 21, 0, 255));
+	}
+
+	// rows are filtered to 14 + 8 - 7 bits, then columns to 14 more; the
+	// negative lobes can't overflow that
+	template<int Taps>
+	BGRA gather(const ReadOnlyImage& img, const Kernel& k, Vec2<int32_t> p) {
+		const int x = (p.x >> fixedShift) - (Taps / 2 - 1);
+		const int y = (p.y >> fixedShift) - (Taps / 2 - 1);
+		if (x + Taps <= 0 || img.width <= x || y + Taps <= 0 || img.height <= y) {
+			return BGRA(0, 0, 0, 0);
+		}
+		const int16_t* wx = k.weights[(p.x & (fixedOne - 1)) >> (fixedShift - phaseBits)];
+		const int16_t* wy = k.weights[(p.y & (fixedOne - 1)) >> (fixedShift - phaseBits)];
+		const bool inside = 0 <= x && x + Taps <= img.width && 0 <= y && y + Taps <= img.height;
+
+		int acc[4] = {};
+		for (int j = 0; j < Taps; j++) {
+			int row[4] = {};
+			for (int i = 0; i < Taps; i++) {
+				BGRA c = inside ? img.data[x + i + img.width * (y + j)] : img.getPixelSafe(x + i, y + j);
+				row[0] += wx[i] * c.b;
+				row[1] += wx[i] * c.g;
+				row[2] += wx[i] * c.r;
+				row[3] += wx[i] * c.a;
+			}
+			for (int c = 0; c < 4; c++) {
+				acc[c] += (row[c] >> 7) * wy[j];
+			}
+		}
+		return BGRA(toChannel(acc[0]), toChannel(acc[1]), toChannel(acc[2]), toChannel(acc[3]));
+	}
+}
+
+namespace resample {
+	const Kernel& kernel(int mode) {
+		static const Kernel bicubic = makeKernel(4, cubic);
+		static const Kernel lanczos = makeKernel(6, lanczos3);
+		return mode == interpolate::lanczos3Mode ? lanczos : bicubic;
+	}
+
+	BGRA gatherPixel(const ReadOnlyImage& img, const Kernel& k, Vec2<int32_t> p) {
+		return k.taps == 4 ? gather<4>(img, k, p) : gather<6>(img, k, p);
+	}
+
+	void bicubicSpan(const ReadOnlyImage& img, const Vec2<int32_t>* pts, BGRA* out, int n) {
+		const Kernel& k = kernel(interpolate::bicubicMode);
+		for (int i = 0; i < n; i++) {
+			out[i] = gather<4>(img, k, pts[i]);
+		}
+	}
+
+	void lanczos3Span(const ReadOnlyImage& img, const Vec2<int32_t>* pts, BGRA* out, int n) {
+		const Kernel& k = kernel(interpolate::lanczos3Mode);
+		for (int i = 0; i < n; i++) {
+			out[i] = gather<6>(img, k, pts[i]);
+		}
+	}
+
+	std::vector<Taps> axisTaps(const Kernel& k, double scale, double offset, int size, int begin, int end) {
+		std::vector<Taps> taps;
+		taps.reserve(std::max(end - begin, 0));
+		for (int x = begin; x < end; x++) {
+			const int32_t f = interpolate::toFixed(scale * x + offset, size);
+			taps.push_back(Taps{
+				(f >> fixedShift) - (k.taps / 2 - 1),
+				k.weights[(f & (fixedOne - 1)) >> (fixedShift - phaseBits)],
+			});
+		}
+		return taps;
+	}
+
+	void separableRow(
+		const ReadOnlyImage& img, const Kernel& k, const Taps& rowTaps,
+		const Taps* columns, int columnBase, int x0, int x1, BGRA* out)
+	{
+		// source columns needed by [x0, x1), filtered vertically
+		const int left = columns[x0 - columnBase].first;
+		const int right = columns[x1 - 1 - columnBase].first + k.taps;
+		thread_local std::vector<int> vertical;
+		vertical.assign(static_cast<size_t>(right - left) * 4, 0);
+
+		const int y = rowTaps.first;
+		for (int j = 0; j < k.taps; j++) {
+			if (y + j < 0 || img.height <= y + j) continue;
+			const BGRA* row = img.data + img.width * (y + j);
+			const int w = rowTaps.weights[j];
+			for (int c = std::max(left, 0); c < std::min(right, img.width); c++) {
+				int* v = &vertical[(c - left) * 4];
+				v[0] += w * row[c].b;
+				v[1] += w * row[c].g;
+				v[2] += w * row[c].r;
+				v[3] += w * row[c].a;
+			}
+		}
+		for (int& v : vertical) {
+			v >>= 7;
+		}
+
+		for (int x = x0; x < x1; x++) {
+			const Taps& t = columns[x - columnBase];
+			const int* v = &vertical[(t.first - left) * 4];
+			int acc[4] = {};
+			for (int i = 0; i < k.taps; i++) {
+				for (int c = 0; c < 4; c++) {
+					acc[c] += t.weights[i] * v[i * 4 + c];
+				}
+			}
+			out[x - x0] = BGRA(toChannel(acc[0]), toChannel(acc[1]), toChannel(acc[2]), toChannel(acc[3]));
+		}
+	}
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "graphic.h"
+
+// Bicubic (Catmull-Rom) and Lanczos-3 resampling. Weights come from
+// per-kernel tables of 256 phases in 14 bit fixed point, shared by the
+// per-pixel gather and the separable path for axis-aligned draws.
+namespace resample
+{
+	constexpr int phaseBits = 8;
+	constexpr int phases = 1 << phaseBits;
+	constexpr int maxTaps = 6;
+
+	struct Kernel {
+		int taps;
+		// weights[phase][tap], each row sums to 16384; tap i is texel
+		// floor(p) - (taps / 2 - 1) + i
+		int16_t weights[phases][maxTaps];
+	};
+
+	// mode is interpolate::bicubicMode or interpolate::lanczos3Mode
+	const Kernel& kernel(int mode);
+
+	// gather samplers, points in 16.16 fixed point
+	BGRA gatherPixel(const ReadOnlyImage& img, const Kernel& k, Vec2<int32_t> p);
+	void bicubicSpan(const ReadOnlyImage& img, const Vec2<int32_t>* pts, BGRA* out, int n);
+	void lanczos3Span(const ReadOnlyImage& img, const Vec2<int32_t>* pts, BGRA* out, int n);
+	void bicubicSpanSSE41(const ReadOnlyImage& img, const Vec2<int32_t>* pts, BGRA* out, int n);
+	void lanczos3SpanSSE41(const ReadOnlyImage& img, const Vec2<int32_t>* pts, BGRA* out, int n);
+
+	// first texel and weights of every destination column (or row) of an
+	// axis-aligned draw
+	struct Taps {
+		int first;
+		const int16_t* weights;
+	};
+
+	// taps of destination positions [begin, end) whose source coordinate
+	// is scale * x + offset
+	std::vector<Taps> axisTaps(const Kernel& k, double scale, double offset, int size, int begin, int end);
+
+	// Filters pixels [x0, x1) of one destination row into out: vertically
+	// with rowTaps over the needed source columns, then horizontally with
+	// columns[x - columnBase].
+	void separableRow(
+		const ReadOnlyImage& img, const Kernel& k, const Taps& rowTaps,
+		const Taps* columns, int columnBase, int x0, int x1, BGRA* out);
+}
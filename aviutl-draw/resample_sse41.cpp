@@ -0,0 +1,71 @@
+#include "resample.h"
+#include "interpolate.h"
+#include "cpu.h"
+
+#ifdef CPU_X86
+#include <smmintrin.h>
+
+using namespace resample;
+
+// Only the out-of-line kernel() and gatherPixel() of resample.cpp are
+// called from here. The pixels are stored channel by channel rather than
+// built with the inline BGRA constructor, whose copy compiled with SSE4.1
+// could be the one the linker keeps for every caller.
+namespace {
+	// b,g,r,a of two neighbouring pixels paired per channel, as 16 bit
+	inline __m128i pair(__m128i px) {
+		const __m128i shuffle = _mm_setr_epi8(0, 4, 1, 5, 2, 6, 3, 7, -1, -1, -1, -1, -1, -1, -1, -1);
+		return _mm_cvtepu8_epi16(_mm_shuffle_epi8(px, shuffle));
+	}
+
+	inline __m128i weights(const int16_t* w, int i) {
+		return _mm_set1_epi32((w[i + 1] << 16) | static_cast<uint16_t>(w[i]));
+	}
+
+	// same arithmetic as gather() in resample.cpp, written to out
+	template<int Taps>
+	inline void gather(const ReadOnlyImage& img, const Kernel& k, Vec2<int32_t> p, BGRA* out) {
+		const int x = (p.x >> interpolate::fixedShift) - (Taps / 2 - 1);
+		const int y = (p.y >> interpolate::fixedShift) - (Taps / 2 - 1);
+		if (!(0 <= x && x + Taps <= img.width && 0 <= y && y + Taps <= img.height)) {
+			*out = gatherPixel(img, k, p);
+			return;
+		}
+		const int shift = interpolate::fixedShift - phaseBits;
+		const int16_t* wx = k.weights[(p.x & (interpolate::fixedOne - 1)) >> shift];
+		const int16_t* wy = k.weights[(p.y & (interpolate::fixedOne - 1)) >> shift];
+
+		__m128i acc = _mm_setzero_si128();
+		for (int j = 0; j < Taps; j++) {
+			const BGRA* row = img.data + x + img.width * (y + j);
+			__m128i sum = _mm_setzero_si128();
+			for (int i = 0; i < Taps; i += 2) {
+				__m128i px = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(row + i));
+				sum = _mm_add_epi32(sum, _mm_madd_epi16(pair(px), weights(wx, i)));
+			}
+			acc = _mm_add_epi32(acc, _mm_mullo_epi32(_mm_srai_epi32(sum, 7), _mm_set1_epi32(wy[j])));
+		}
+		acc = _mm_srai_epi32(_mm_add_epi32(acc, _mm_set1_epi32(1 << 20)), 21);
+		acc = _mm_packus_epi16(_mm_packs_epi32(acc, acc), acc);
+		const uint32_t c = static_cast<uint32_t>(_mm_cvtsi128_si32(acc));
+		out->b = static_cast<uint8_t>(c);
+		out->g = static_cast<uint8_t>(c >> 8);
+		out->r = static_cast<uint8_t>(c >> 16);
+		out->a = static_cast<uint8_t>(c >> 24);
+	}
+}
+
+void resample::bicubicSpanSSE41(const ReadOnlyImage& img, const Vec2<int32_t>* pts, BGRA* out, int n) {
+	const Kernel& k = kernel(interpolate::bicubicMode);
+	for (int i = 0; i < n; i++) {
+		gather<4>(img, k, pts[i], out + i);
+	}
+}
+
+void resample::lanczos3SpanSSE41(const ReadOnlyImage& img, const Vec2<int32_t>* pts, BGRA* out, int n) {
+	const Kernel& k = kernel(interpolate::lanczos3Mode);
+	for (int i = 0; i < n; i++) {
+		gather<6>(img, k, pts[i], out + i);
+	}
+}
+#endif
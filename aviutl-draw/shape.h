@@ -0,0 +1,167 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include "graphic.h"
+#include "raster.h"
+#include "render.h"
+
+// Shapes painted straight into the destination, span by span through the
+// blend spans of a pipeline, without a source image.
+namespace shape
+{
+	// color of each destination pixel: solid, or a gradient from color0 to
+	// color1 along p0 -> p1 (linear) or from the center p0 out to radius
+	// (radial), constant past either end
+	struct Paint {
+		enum Type { solid, linear, radial };
+
+		Type type = solid;
+		BGRA color0;
+		BGRA color1;
+		Vec2<Number> p0{};
+		Vec2<Number> p1{};
+		Number radius = 0;
+
+		// paints pixels (x0 + i, y)
+		void fill(int x0, int y, BGRA* px, int n) const {
+			if (type == solid) {
+				std::fill_n(px, n, color0);
+				return;
+			}
+
+			// position along the gradient, 0 at color0 and 1 at color1
+			Number t = 0, dt = 0;
+			const Number x = x0, fy = y;
+			if (type == linear) {
+				const Number dx = p1.x - p0.x, dy = p1.y - p0.y;
+				const Number len2 = dx * dx + dy * dy;
+				if (len2 > 0) {
+					t = ((x - p0.x) * dx + (fy - p0.y) * dy) / len2;
+					dt = dx / len2;
+				}
+				else {
+					t = 1;
+				}
+			}
+			for (int i = 0; i < n; i++) {
+				if (type == radial) {
+					const Number d = std::hypot(x + i - p0.x, fy - p0.y);
+					t = radius > 0 ? d / radius : 1;
+				}
+				px[i] = mix(static_cast<int>(std::clamp(t, static_cast<Number>(0), static_cast<Number>(1)) * 256 + 0.5));
+				t += dt;
+			}
+		}
+
+	private:
+		BGRA mix(int weight) const {
+			auto f = [=](int c0, int c1) {
+				return static_cast<uint8_t>(c0 + (((c1 - c0) * weight + 128) >> 8));
+			};
+			return BGRA(f(color0.b, color1.b), f(color0.g, color1.g), f(color0.r, color1.r), f(color0.a, color1.a));
+		}
+	};
+
+	// A filled polygon (convex or not, even-odd) or circle, in destination
+	// pixel coordinates where pixel centers are integers.
+	struct Shape {
+		Vec2<Number> pts[raster::maxPolygonPoints];
+		int count = 0;
+		// a circle when radius > 0
+		Vec2<Number> center{};
+		Number radius = 0;
+		// set by antialias() for convex polygons
+		raster::Coverage edges;
+		bool antialiased = false;
+
+		static Shape polygon(const Vec2<Number>* points, int n) {
+			Shape s;
+			s.count = std::min(n, raster::maxPolygonPoints);
+			std::copy(points, points + s.count, s.pts);
+			return s;
+		}
+
+		static Shape circle(Vec2<Number> center, Number radius) {
+			Shape s;
+			s.center = center;
+			s.radius = radius;
+			return s;
+		}
+
+		// fades the pixels on the boundary by how much of them the shape
+		// covers; concave polygons stay aliased
+		void antialias() {
+			if (radius > 0) {
+				antialiased = true;
+			}
+			else if (edges.init(pts, count)) {
+				edges.outline(pts);
+				antialiased = true;
+			}
+		}
+
+		// rows and columns it can cover inside clip
+		Rect bounds(const Rect& clip) const {
+			if (radius > 0) {
+				const Number r = radius + (antialiased ? 0.5 : 0);
+				const Vec2<Number> corners[2] = { { center.x - r, center.y - r }, { center.x + r, center.y + r } };
+				return raster::bounds(corners, 2, clip);
+			}
+			return count >= 3 ? raster::bounds(pts, count, clip) : Rect();
+		}
+
+		// calls span(y, x0, x1) for the pixels inside
+		template<class F>
+		void scan(const Rect& clip, F&& span) const {
+			if (radius <= 0) {
+				raster::scanPolygon(pts, count, clip, span);
+				return;
+			}
+			const Number r = radius + (antialiased ? 0.5 : 0);
+			const Rect b = bounds(clip);
+			for (int y = b.top; y < b.bottom; y++) {
+				const Number dy = y - center.y;
+				if (!(dy * dy < r * r)) continue;
+				const Number half = std::sqrt(r * r - dy * dy);
+				// strictly inside, as scanPolygon
+				const int x0 = std::max(static_cast<int>(std::floor(center.x - half)) + 1, b.left);
+				const int x1 = std::min(static_cast<int>(std::ceil(center.x + half)), b.right);
+				if (x0 < x1) span(y, x0, x1);
+			}
+		}
+
+		// scales the alpha of the pixels (x0 + i, y) on the edge of a circle
+		void fadeCircle(int x0, int y, BGRA* px, int n) const {
+			const Number dy = y - center.y;
+			for (int i = 0; i < n; i++) {
+				const Number coverage = std::clamp(radius + 0.5 - std::hypot(x0 + i - center.x, dy),
+					static_cast<Number>(0), static_cast<Number>(1));
+				if (coverage < 1) {
+					px[i].a = static_cast<uint8_t>(px[i].a * coverage + 0.5);
+				}
+			}
+		}
+	};
+
+	// paints the pixels of shape inside clip through the blend of pipeline
+	inline void draw(Image& dest, const render::Pipeline& pipeline, const Shape& shape, const Paint& paint, const Rect& clip) {
+		render::Pipeline p = pipeline;
+		const bool circle = shape.radius > 0;
+		if (shape.antialiased && !circle) {
+			p.coverage = &shape.edges;
+		}
+		BGRA px[render::spanLength];
+		shape.scan(clip, [&](int y, int sx, int ex) {
+			for (int x0 = sx; x0 < ex; x0 += render::spanLength) {
+				const int n = std::min(render::spanLength, ex - x0);
+				paint.fill(x0, y, px, n);
+				if (shape.antialiased && circle) {
+					shape.fadeCircle(x0, y, px, n);
+				}
+				render::blendRun(dest, p, y, x0, px, n);
+			}
+		});
+	}
+}
@@ -0,0 +1,91 @@
+#include "threadpool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(int threads) {
+	if (threads <= 0) {
+		threads = static_cast<int>(std::thread::hardware_concurrency());
+	}
+	// the threads already started are joined when one fails to start,
+	// so the exception doesn't destroy them while they run
+	try {
+		for (int i = 1; i < threads; i++) {
+			workers.emplace_back(&ThreadPool::work, this);
+		}
+	}
+	catch (...) {
+		stop();
+		throw;
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	stop();
+}
+
+void ThreadPool::stop() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (auto& t : workers) {
+		t.join();
+	}
+}
+
+void ThreadPool::parallelFor(int first, int last, const std::function<void(int, int)>& func) {
+	if (last <= first) return;
+	if (workers.empty() || last - first == 1) {
+		func(first, last);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		// a few bands per thread so uneven rows are balanced
+		int bands = std::min(last - first, threads() * 4);
+		this->job = &func;
+		this->first = first;
+		this->last = last;
+		this->bandSize = (last - first + bands - 1) / bands;
+		this->bandCount = (last - first + bandSize - 1) / bandSize;
+		this->nextBand = 0;
+		this->busy = static_cast<int>(workers.size());
+		this->generation++;
+	}
+	wake.notify_all();
+
+	runBands();
+
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [this] { return busy == 0; });
+	job = nullptr;
+}
+
+void ThreadPool::work() {
+	unsigned seen = 0;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&] { return stopping || generation != seen; });
+			if (stopping) return;
+			seen = generation;
+		}
+
+		runBands();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (--busy == 0) {
+			done.notify_one();
+		}
+	}
+}
+
+void ThreadPool::runBands() {
+	for (;;) {
+		int band = nextBand.fetch_add(1);
+		if (band >= bandCount) break;
+		int begin = first + band * bandSize;
+		(*job)(begin, std::min(last, begin + bandSize));
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+	// threads <= 0 uses one thread per hardware thread
+	explicit ThreadPool(int threads = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// number of threads including the calling thread
+	int threads() const {
+		return static_cast<int>(workers.size()) + 1;
+	}
+
+	// split [first, last) into bands and call func(begin, end) for each band.
+	// the calling thread takes part and returns when all bands are done.
+	void parallelFor(int first, int last, const std::function<void(int, int)>& func);
+
+private:
+	void work();
+	void stop();
+	void runBands();
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	bool stopping = false;
+	unsigned generation = 0;
+	int busy = 0;
+
+	const std::function<void(int, int)>* job = nullptr;
+	int first = 0;
+	int last = 0;
+	int bandSize = 0;
+	int bandCount = 0;
+	std::atomic<int> nextBand = 0;
+};
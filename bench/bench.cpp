@@ -0,0 +1,403 @@
+// Throughput of draw() and drawperspective() for the composite, blend and
+// interpolation modes, in destination megapixels per second. The
+// blendtable suite times the separable blend modes reading a table and
+// calling the function, on sourceOver spans without a draw around them.
+//
+//   aviutl-draw-bench [--suite blend|interpolate|perspective|blendtable|all]
+//                     [--format csv|json] [--out file] [--min-time ms]
+//                     [--threads n] [--premultiplied]
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+#include "batch.h"
+#include "blendtable.h"
+#include "cpu.h"
+#include "mipmap.h"
+#include "threadpool.h"
+
+namespace {
+	const char* compositeNames[] = {
+		"clear", "copy", "destination", "sourceOver", "destinationOver",
+		"sourceIn", "destinationIn", "sourceOut", "destinationOut",
+		"sourceAtop", "destinationAtop", "exclusiveOR", "lighter",
+	};
+	const char* blendNames[] = {
+		"Normal", "Addition", "Subtract", "Multiply", "Screen", "Overlay", "Lighten", "Darken",
+		"Luminosity", "Color", "LinearBurn", "LinearLight", "Difference", "Exclusion",
+		"Divide", "ColorDodge", "ColorBurn", "HardMix",
+		"AND", "NAND", "OR", "NOR", "XOR", "XNOR",
+		"IMPLICATION", "NOT IMPLICATION", "CONVERSE", "NOT CONVERSE",
+	};
+	const char* interpolateNames[] = { "nearest", "bilinear", "mipmap", "bicubic", "lanczos3" };
+
+	static_assert(std::size(compositeNames) == render::compositeCount);
+	static_assert(std::size(blendNames) == render::blendCount);
+	static_assert(std::size(interpolateNames) == render::interpolateCount);
+
+	struct Options {
+		std::string suite = "all";
+		std::string format = "csv";
+		std::string out;
+		double minTime = 50;
+		int threads = 1;
+		bool premultiplied = false;
+	};
+
+	struct Case {
+		std::string suite;
+		// draw or drawperspective, or table or function in blendtable
+		std::string function;
+		int composite = 3;
+		int blend = 0;
+		int interpolate = 1;
+		int size = 512;
+		Number zoom = 1;
+		Number rotate = 0;
+		// drawperspective() corners as offsets of the dest corners, in
+		// fractions of the dest size
+		Number skew = 0;
+	};
+
+	struct Result {
+		Case c;
+		int64_t pixels;
+		int iterations;
+		double ms;
+	};
+
+	constexpr int destWidth = 1920;
+	constexpr int destHeight = 1080;
+
+	// a quarter each of transparent and opaque pixels, the rest random
+	std::vector<BGRA> randomPixels(std::mt19937& rng, int w, int h) {
+		std::vector<BGRA> v(static_cast<size_t>(w) * h);
+		for (auto& p : v) {
+			const uint32_t x = rng();
+			p = BGRA(static_cast<uint8_t>(x), static_cast<uint8_t>(x >> 8), static_cast<uint8_t>(x >> 16), static_cast<uint8_t>(x >> 24));
+			switch (rng() % 4) {
+			case 0: p.a = 0; break;
+			case 1: p.a = 255; break;
+			}
+		}
+		return v;
+	}
+
+	// Blend modes whose result channel depends only on the same channel of
+	// dest and src, so a 256x256 table can stand in for them. The first
+	// tabulatedCount are read from blend::table() by the blend spans, the
+	// rest call the function.
+	constexpr blend::Blend separableModes[] = {
+		blend::overlay, blend::screen, blend::exclusion,
+		blend::divide, blend::colorDodge, blend::colorBurn,
+		blend::multiply, blend::linearBurn, blend::linearLight, blend::hardMix, blend::lighten, blend::darken,
+		blend::difference, blend::addition, blend::subtract,
+	};
+	constexpr size_t tabulatedCount = 6;
+
+	template<size_t... I>
+	constexpr bool tabulatedFirst(std::index_sequence<I...>) {
+		return ((blend::tabulated<separableModes[I]> == (I < tabulatedCount)) && ...);
+	}
+	static_assert(tabulatedFirst(std::make_index_sequence<std::size(separableModes)>{}),
+		"separableModes must list the tabulated modes first");
+	std::unique_ptr<blend::Table> separableTables[std::size(separableModes)];
+
+	// separableModes[I] read from its table, like blend::apply() does
+	template<size_t I>
+	BGRA fromTable(BGRA dest, BGRA src) {
+		const blend::Table* t = separableTables[I].get();
+		return BGRA(t->value[dest.b][src.b], t->value[dest.g][src.g], t->value[dest.r][src.r]);
+	}
+
+	using ModeSpan = void(*)(BGRA* dest, const BGRA* src, int n, const render::AlphaTable& alpha);
+
+	// blendSpan<sourceOver, Mode> without the shortcuts for decided pixels,
+	// so only the blend mode differs between the two ways
+	template<blend::Blend Mode, bool Premultiplied>
+	void modeSpan(BGRA* dest, const BGRA* src, int n, const render::AlphaTable& alpha) {
+		for (int i = 0; i < n; i++) {
+			BGRA ps = src[i];
+			ps.a = alpha.value[ps.a];
+			if constexpr (Premultiplied) {
+				dest[i] = render::blendColorPremultiplied<composite::sourceOver, Mode>(dest[i], ps);
+			}
+			else {
+				dest[i] = render::blendColor<composite::sourceOver, Mode>(dest[i], ps);
+			}
+		}
+	}
+
+	// index = separable mode * 4 + table * 2 + premultiplied
+	template<size_t... I>
+	constexpr std::array<ModeSpan, sizeof...(I) * 4> makeModeSpans(std::index_sequence<I...>) {
+		std::array<ModeSpan, sizeof...(I) * 4> spans{};
+		((spans[I * 4] = &modeSpan<separableModes[I], false>,
+			spans[I * 4 + 1] = &modeSpan<separableModes[I], true>,
+			spans[I * 4 + 2] = &modeSpan<fromTable<I>, false>,
+			spans[I * 4 + 3] = &modeSpan<fromTable<I>, true>), ...);
+		return spans;
+	}
+
+	constexpr auto modeSpans = makeModeSpans(std::make_index_sequence<std::size(separableModes)>{});
+
+	batch::Command makeCommand(const Case& c, const Image& dest, const ReadOnlyImage& src, bool premultiplied) {
+		const render::Pipeline pipeline(c.composite, c.blend, c.interpolate, 1.0, premultiplied);
+		if (c.function == "drawperspective") {
+			const Number w = dest.width, h = dest.height;
+			const Number dx = w * c.skew, dy = h * c.skew;
+			Vec2<Number> xy[4] = {
+				{ dx, dy }, { w - dx * 2, 0 }, { w, h - dy }, { 0, h },
+			};
+			Vec2<Number> uv[4] = {
+				{ 0, 0 }, { static_cast<Number>(src.width), 0 },
+				{ static_cast<Number>(src.width), static_cast<Number>(src.height) },
+				{ 0, static_cast<Number>(src.height) },
+			};
+			Mat<double> mat;
+			getPerspective(uv, xy, mat);
+			return batch::Command(dest, src, pipeline, mat, xy);
+		}
+		std::function<std::shared_ptr<const mipmap::Pyramid>()> pyramidOf;
+		if (c.interpolate == interpolate::mipmapMode) {
+			pyramidOf = [&] { return std::make_shared<const mipmap::Pyramid>(src); };
+		}
+		return batch::Command(dest, src, pipeline, c.interpolate, 0, 0, c.zoom, c.rotate, pyramidOf);
+	}
+
+	// destination pixels the command writes
+	int64_t coverage(const batch::Command& cmd) {
+		int64_t n = 0;
+		raster::scanPolygon(cmd.quad, 4, cmd.bounds, [&](int, int x0, int x1) {
+			n += x1 - x0;
+		});
+		return n;
+	}
+
+	// the sourceOver span of a separable mode, on size x size pixels
+	Result runBlendTable(const Case& c, const Options& opt) {
+		std::mt19937 rng(1);
+		const auto src = randomPixels(rng, c.size, c.size);
+		auto initial = randomPixels(rng, c.size, c.size);
+		if (opt.premultiplied) {
+			for (auto& p : initial) p = toPremultiplied(p);
+		}
+		auto dest = initial;
+
+		const size_t m = std::find(std::begin(separableModes), std::end(separableModes), blend::modes[c.blend])
+			- std::begin(separableModes);
+		if (!separableTables[m]) {
+			separableTables[m] = std::make_unique<blend::Table>(separableModes[m]);
+		}
+		const ModeSpan span = modeSpans[m * 4 + (c.function == "table" ? 2 : 0) + (opt.premultiplied ? 1 : 0)];
+		const render::AlphaTable alpha(1.0);
+		const int n = static_cast<int>(src.size());
+
+		using clock = std::chrono::steady_clock;
+		double total = 0;
+		int iterations = 0;
+		while (total < opt.minTime || iterations < 3) {
+			dest = initial;
+			const auto t0 = clock::now();
+			span(dest.data(), src.data(), n, alpha);
+			total += std::chrono::duration<double, std::milli>(clock::now() - t0).count();
+			iterations++;
+		}
+		return Result{ c, n, iterations, total / iterations };
+	}
+
+	Result run(const Case& c, const Options& opt, ThreadPool* pool) {
+		if (c.suite == "blendtable") return runBlendTable(c, opt);
+		std::mt19937 rng(1);
+		const auto srcPixels = randomPixels(rng, c.size, c.size);
+		const auto destPixels = randomPixels(rng, destWidth, destHeight);
+		const ReadOnlyImage src(srcPixels.data(), c.size, c.size);
+
+		Image dest(destPixels.data(), destWidth, destHeight);
+		if (opt.premultiplied) dest.premultiply();
+		const Image initial = dest;
+		const batch::Command cmd = makeCommand(c, dest, src, opt.premultiplied);
+
+		using clock = std::chrono::steady_clock;
+		double total = 0;
+		int iterations = 0;
+		while (total < opt.minTime || iterations < 3) {
+			// every iteration starts from the same dest, outside the timing
+			memcpy(dest.pixels, initial.pixels, sizeof(BGRA) * destWidth * destHeight);
+			const auto t0 = clock::now();
+			if (pool) {
+				pool->parallelFor(cmd.bounds.top, cmd.bounds.bottom, [&](int y0, int y1) {
+					cmd.draw(dest, Rect(cmd.bounds.left, y0, cmd.bounds.right, y1));
+				});
+			}
+			else {
+				cmd.draw(dest, cmd.bounds);
+			}
+			total += std::chrono::duration<double, std::milli>(clock::now() - t0).count();
+			iterations++;
+		}
+		return Result{ c, coverage(cmd), iterations, total / iterations };
+	}
+
+	std::vector<Case> cases(const std::string& suite) {
+		std::vector<Case> list;
+		if (suite == "blend" || suite == "all") {
+			for (int comp = 0; comp < render::compositeCount; comp++) {
+				for (int bl = 0; bl < render::blendCount; bl++) {
+					Case c;
+					c.suite = "blend";
+					c.function = "draw";
+					c.composite = comp;
+					c.blend = bl;
+					// rotated slightly, so every pixel goes through the sampler
+					c.rotate = 0.1;
+					list.push_back(c);
+				}
+			}
+		}
+		if (suite == "interpolate" || suite == "all") {
+			const Number transforms[][2] = { { 1, 0 }, { 2, 0 }, { 0.37, 0 }, { 1, 0.3 }, { 0.37, 0.3 } };
+			for (int mode = 0; mode < render::interpolateCount; mode++) {
+				for (int size : { 64, 256, 1024 }) {
+					for (auto& t : transforms) {
+						Case c;
+						c.suite = "interpolate";
+						c.function = "draw";
+						c.interpolate = mode;
+						c.size = size;
+						c.zoom = t[0];
+						c.rotate = t[1];
+						list.push_back(c);
+					}
+				}
+			}
+		}
+		if (suite == "perspective" || suite == "all") {
+			for (int mode = 0; mode < render::interpolateCount; mode++) {
+				for (int size : { 256, 1024 }) {
+					for (Number skew : { 0.05, 0.25 }) {
+						Case c;
+						c.suite = "perspective";
+						c.function = "drawperspective";
+						c.interpolate = mode;
+						c.size = size;
+						c.skew = skew;
+						list.push_back(c);
+					}
+				}
+			}
+		}
+		if (suite == "blendtable" || suite == "all") {
+			for (blend::Blend mode : separableModes) {
+				for (const char* way : { "function", "table" }) {
+					Case c;
+					c.suite = "blendtable";
+					c.function = way;
+					c.blend = static_cast<int>(std::find(std::begin(blend::modes), std::end(blend::modes), mode)
+						- std::begin(blend::modes));
+					c.size = 1024;
+					list.push_back(c);
+				}
+			}
+		}
+		return list;
+	}
+
+	double mpxPerSecond(const Result& r) {
+		return r.ms > 0 ? r.pixels / (r.ms * 1000) : 0;
+	}
+
+	void writeCsv(FILE* f, const std::vector<Result>& results) {
+		fprintf(f, "suite,function,composite,blend,interpolate,size,zoom,rotate,skew,pixels,iterations,ms,mpx_per_s\n");
+		for (const auto& r : results) {
+			const Case& c = r.c;
+			fprintf(f, "%s,%s,%s,%s,%s,%d,%g,%g,%g,%lld,%d,%.4f,%.2f\n",
+				c.suite.c_str(), c.function.c_str(), compositeNames[c.composite], blendNames[c.blend],
+				interpolateNames[c.interpolate], c.size, c.zoom, c.rotate, c.skew,
+				static_cast<long long>(r.pixels), r.iterations, r.ms, mpxPerSecond(r));
+		}
+	}
+
+	void writeJson(FILE* f, const std::vector<Result>& results, const Options& opt) {
+		fprintf(f, "{\n  \"context\": {\"dest\": \"%dx%d\", \"threads\": %d, \"premultiplied\": %s, \"sse41\": %s, \"avx2\": %s},\n",
+			destWidth, destHeight, opt.threads, opt.premultiplied ? "true" : "false",
+			cpu::hasSSE41() ? "true" : "false", cpu::hasAVX2() ? "true" : "false");
+		fprintf(f, "  \"results\": [\n");
+		for (size_t i = 0; i < results.size(); i++) {
+			const Result& r = results[i];
+			const Case& c = r.c;
+			fprintf(f, "    {\"suite\": \"%s\", \"function\": \"%s\", \"composite\": \"%s\", \"blend\": \"%s\", "
+				"\"interpolate\": \"%s\", \"size\": %d, \"zoom\": %g, \"rotate\": %g, \"skew\": %g, "
+				"\"pixels\": %lld, \"iterations\": %d, \"ms\": %.4f, \"mpx_per_s\": %.2f}%s\n",
+				c.suite.c_str(), c.function.c_str(), compositeNames[c.composite], blendNames[c.blend],
+				interpolateNames[c.interpolate], c.size, c.zoom, c.rotate, c.skew,
+				static_cast<long long>(r.pixels), r.iterations, r.ms, mpxPerSecond(r),
+				i + 1 < results.size() ? "," : "");
+		}
+		fprintf(f, "  ]\n}\n");
+	}
+
+	bool parse(int argc, char** argv, Options& opt) {
+		for (int i = 1; i < argc; i++) {
+			const std::string arg = argv[i];
+			const bool hasValue = i + 1 < argc;
+			if (arg == "--suite" && hasValue) opt.suite = argv[++i];
+			else if (arg == "--format" && hasValue) opt.format = argv[++i];
+			else if (arg == "--out" && hasValue) opt.out = argv[++i];
+			else if (arg == "--min-time" && hasValue) opt.minTime = atof(argv[++i]);
+			else if (arg == "--threads" && hasValue) opt.threads = atoi(argv[++i]);
+			else if (arg == "--premultiplied") opt.premultiplied = true;
+			else return false;
+		}
+		return opt.format == "csv" || opt.format == "json";
+	}
+}
+
+int main(int argc, char** argv) {
+	Options opt;
+	if (!parse(argc, argv, opt)) {
+		fprintf(stderr,
+			"usage: %s [--suite blend|interpolate|perspective|blendtable|all] [--format csv|json]\n"
+			"          [--out file] [--min-time ms] [--threads n] [--premultiplied]\n", argv[0]);
+		return 2;
+	}
+
+	const auto list = cases(opt.suite);
+	if (list.empty()) {
+		fprintf(stderr, "unknown suite %s\n", opt.suite.c_str());
+		return 2;
+	}
+
+	std::unique_ptr<ThreadPool> pool;
+	if (opt.threads != 1) {
+		pool = std::make_unique<ThreadPool>(opt.threads);
+	}
+
+	std::vector<Result> results;
+	for (size_t i = 0; i < list.size(); i++) {
+		results.push_back(run(list[i], opt, pool.get()));
+		fprintf(stderr, "\r%zu/%zu", i + 1, list.size());
+	}
+	fprintf(stderr, "\n");
+
+	FILE* f = opt.out.empty() ? stdout : fopen(opt.out.c_str(), "w");
+	if (!f) {
+		fprintf(stderr, "can't open %s\n", opt.out.c_str());
+		return 1;
+	}
+	if (opt.format == "json") writeJson(f, results, opt);
+	else writeCsv(f, results);
+	if (f != stdout) fclose(f);
+	return 0;
+}
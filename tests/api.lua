@@ -0,0 +1,39 @@
+-- Checks of the Lua API of the module built at the path given as arg[1]:
+--
+--   lua5.1 api.lua path/to/KaroterraDraw.so
+
+local open = assert(package.loadlib(arg[1], "luaopen_KaroterraDraw"))
+local KD = open()
+
+local failures = 0
+
+local function check(name, ok)
+	if not ok then
+		print("  " .. name .. ": failed")
+		failures = failures + 1
+	end
+end
+
+-- arguments that must raise a Lua error instead of crashing the host
+local function raises(name, f, ...)
+	check(name, not pcall(f, ...))
+end
+
+print("canvas ids")
+for _, id in ipairs({ { nil }, { {} }, { true } }) do
+	local t = type(id[1])
+	raises("select(" .. t .. ")", KD.select, id[1])
+	raises("freecanvas(" .. t .. ")", KD.freecanvas, id[1])
+	raises("drawcanvas(" .. t .. ")", KD.drawcanvas, id[1])
+end
+check("select(string)", pcall(KD.select, "a"))
+check("select(number)", pcall(KD.select, 1))
+check("freecanvas(string)", pcall(KD.freecanvas, "a"))
+check("select back", pcall(KD.select, "0"))
+
+print("threads")
+check("setthreads(huge)", pcall(KD.setthreads, 1e12))
+check("setthreads(1)", pcall(KD.setthreads, 1))
+
+print(failures > 0 and failures .. " failures" or "ok")
+os.exit(failures > 0 and 1 or 0)
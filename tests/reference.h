@@ -0,0 +1,199 @@
+#pragma once
+
+// The scalar kernels as they were before any optimization, kept as the
+// oracle the optimized paths are compared against. Only blend.h and
+// composite.h are shared: their functions are still the reference ones,
+// the tables of blendtable.h are built from them but not used here.
+
+#include <stdint.h>
+#include <algorithm>
+#include "graphic.h"
+#include "mat.h"
+#include "composite.h"
+#include "blend.h"
+
+namespace reference
+{
+	struct YCbCr {
+		short y, cb, cr;
+	};
+
+	inline YCbCr toYCbCr(BGRA rgb) {
+		return YCbCr{
+			static_cast<short>(0.299 * rgb.r + 0.587 * rgb.g + 0.114 * rgb.b),
+			static_cast<short>(-0.168736 * rgb.r - 0.331264 * rgb.g + 0.5 * rgb.b),
+			static_cast<short>(0.5 * rgb.r - 0.418688 * rgb.g - 0.081312 * rgb.b),
+		};
+	}
+
+	inline BGRA toBGRA(YCbCr c) {
+		using std::clamp;
+		return BGRA(
+			static_cast<uint8_t>(clamp(c.y + 1.772 * c.cb, 0., 255.)),
+			static_cast<uint8_t>(clamp(c.y - 0.344136 * c.cb - 0.714136 * c.cr, 0., 255.)),
+			static_cast<uint8_t>(clamp(c.y + 1.402 * c.cr, 0., 255.))
+		);
+	}
+
+	inline BGRA luminosity(BGRA dest, BGRA src) {
+		YCbCr yd = toYCbCr(dest), ys = toYCbCr(src);
+		return toBGRA(YCbCr{ ys.y, yd.cb, yd.cr });
+	}
+
+	inline BGRA color(BGRA dest, BGRA src) {
+		YCbCr yd = toYCbCr(dest), ys = toYCbCr(src);
+		return toBGRA(YCbCr{ yd.y, ys.cb, ys.cr });
+	}
+
+	// blend::modes with the double precision YCbCr modes
+	inline blend::Blend blendMode(int i) {
+		if (blend::modes[i] == blend::luminosity) return luminosity;
+		if (blend::modes[i] == blend::color) return color;
+		return blend::modes[i];
+	}
+
+	inline BGRA blendColor(composite::Composite compositeMode, blend::Blend blendMode, BGRA pd, BGRA ps, double alpha) {
+		ps.a = static_cast<uint8_t>(ps.a * alpha);
+		int fd, fs;
+		compositeMode(pd, ps, fd, fs);
+
+		int a = (pd.a * fd + ps.a * fs) / 255;
+		auto px = blendMode(pd, ps);
+
+		int r = (pd.a * px.r + (255 - pd.a) * ps.r) / 255;
+		int g = (pd.a * px.g + (255 - pd.a) * ps.g) / 255;
+		int b = (pd.a * px.b + (255 - pd.a) * ps.b) / 255;
+		if (a == 0) {
+			r = g = b = 0;
+		}
+		else {
+			r = (pd.a * fd * pd.r + ps.a * fs * r) / (a * 255);
+			g = (pd.a * fd * pd.g + ps.a * fs * g) / (a * 255);
+			b = (pd.a * fd * pd.b + ps.a * fs * b) / (a * 255);
+		}
+
+		return BGRA(
+			static_cast<uint8_t>(b),
+			static_cast<uint8_t>(g),
+			static_cast<uint8_t>(r),
+			static_cast<uint8_t>(a)
+		);
+	}
+
+	inline BGRA nearestNeighbor(const ReadOnlyImage& img, Vec2<double> p) {
+		return img.samplePixel(p);
+	}
+
+	inline BGRA bilinear(const ReadOnlyImage& img, Vec2<double> p) {
+		int x = static_cast<int>(std::floor(p.x));
+		int y = static_cast<int>(std::floor(p.y));
+		auto dx = p.x - x;
+		auto dy = p.y - y;
+		auto c1 = img.getPixelSafe(x, y);
+		auto c2 = img.getPixelSafe(x, y + 1);
+		auto c3 = img.getPixelSafe(x + 1, y);
+		auto c4 = img.getPixelSafe(x + 1, y + 1);
+
+		return BGRA(
+			static_cast<uint8_t>((1 - dx) * (1 - dy) * c1.b + (1 - dx) * dy * c2.b + dx * (1 - dy) * c3.b + dx * dy * c4.b),
+			static_cast<uint8_t>((1 - dx) * (1 - dy) * c1.g + (1 - dx) * dy * c2.g + dx * (1 - dy) * c3.g + dx * dy * c4.g),
+			static_cast<uint8_t>((1 - dx) * (1 - dy) * c1.r + (1 - dx) * dy * c2.r + dx * (1 - dy) * c3.r + dx * dy * c4.r),
+			static_cast<uint8_t>((1 - dx) * (1 - dy) * c1.a + (1 - dx) * dy * c2.a + dx * (1 - dy) * c3.a + dx * dy * c4.a)
+		);
+	}
+
+	using Sampler = BGRA(*)(const ReadOnlyImage&, Vec2<double>);
+
+	// draw(): every pixel of the bounding box of the transformed source.
+	// The box is truncated and misses the pixels the samplers bleed onto
+	// past the source edges, which the footprint of draw() covers now;
+	// wholeImage visits every pixel of dest to include them.
+	inline void draw(
+		Image& dest, const ReadOnlyImage& src, composite::Composite compositeMode, blend::Blend blendMode,
+		Sampler sample, int ox, int oy, double zoom, double alpha, double rotate, bool wholeImage = false)
+	{
+		Mat<double> mat;
+		mat.translate(-src.width * 0.5, -src.height * 0.5);
+		mat.scale(zoom, zoom);
+		mat.rotate(rotate);
+		mat.translate(dest.width * 0.5 + ox, dest.height * 0.5 + oy);
+		Mat<double> inv = mat.inverse();
+
+		Vec2<double> pts[4] = {
+			mat.transform(Vec2<double>{ 0, 0 }),
+			mat.transform(Vec2<double>{ static_cast<double>(src.width), 0 }),
+			mat.transform(Vec2<double>{ static_cast<double>(src.width), static_cast<double>(src.height) }),
+			mat.transform(Vec2<double>{ 0, static_cast<double>(src.height) }),
+		};
+		int sx = static_cast<int>(pts[0].x), sy = static_cast<int>(pts[0].y);
+		int ex = sx, ey = sy;
+		for (int i = 1; i < 4; i++) {
+			if (pts[i].x < sx) sx = static_cast<int>(pts[i].x);
+			else if (pts[i].x > ex) ex = static_cast<int>(pts[i].x);
+
+			if (pts[i].y < sy) sy = static_cast<int>(pts[i].y);
+			else if (pts[i].y > ey) ey = static_cast<int>(pts[i].y);
+		}
+		sx = std::max(sx, 0);
+		sy = std::max(sy, 0);
+		ex = std::min(ex, dest.width);
+		ey = std::min(ey, dest.height);
+		if (wholeImage) {
+			sx = sy = 0;
+			ex = dest.width;
+			ey = dest.height;
+		}
+
+		for (int y = sy; y < ey; y++) {
+			for (int x = sx; x < ex; x++) {
+				Vec2<double> point = inv.transform(Vec2<double>{ static_cast<double>(x), static_cast<double>(y) });
+				dest.setPixel(x, y, blendColor(compositeMode, blendMode, dest.getPixel(x, y), sample(src, point), alpha));
+			}
+		}
+	}
+
+	// drawPerspective(): the pixels strictly inside the quad xy, within
+	// its truncated bounding box or, with wholeImage, anywhere in dest
+	inline void drawPerspective(
+		Image& dest, const ReadOnlyImage& src, composite::Composite compositeMode, blend::Blend blendMode,
+		Sampler sample, const Vec2<double> xy[4], const Vec2<double> uv[4], double alpha, bool wholeImage = false)
+	{
+		Vec2<double> dst[4] = { xy[0], xy[1], xy[2], xy[3] };
+		Vec2<double> from[4] = { uv[0], uv[1], uv[2], uv[3] };
+		Mat<double> mat;
+		getPerspective(from, dst, mat);
+
+		int sx = static_cast<int>(xy[0].x), sy = static_cast<int>(xy[0].y);
+		int ex = sx, ey = sy;
+		for (int i = 1; i < 4; i++) {
+			if (xy[i].x < sx) sx = static_cast<int>(xy[i].x);
+			else if (xy[i].x > ex) ex = static_cast<int>(xy[i].x);
+
+			if (xy[i].y < sy) sy = static_cast<int>(xy[i].y);
+			else if (xy[i].y > ey) ey = static_cast<int>(xy[i].y);
+		}
+		sx = std::max(sx, 0);
+		sy = std::max(sy, 0);
+		ex = std::min(ex, dest.width);
+		ey = std::min(ey, dest.height);
+		if (wholeImage) {
+			sx = sy = 0;
+			ex = dest.width;
+			ey = dest.height;
+		}
+
+		for (int y = sy; y < ey; y++) {
+			for (int x = sx; x < ex; x++) {
+				Vec2<double> pt{ static_cast<double>(x), static_cast<double>(y) };
+				if (cross(xy[0], pt, xy[1]) < 0
+					&& cross(xy[1], pt, xy[2]) < 0
+					&& cross(xy[2], pt, xy[3]) < 0
+					&& cross(xy[3], pt, xy[0]) < 0)
+				{
+					Vec2<double> point = mat.mapPerspective(pt);
+					dest.setPixel(x, y, blendColor(compositeMode, blendMode, dest.getPixel(x, y), sample(src, point), alpha));
+				}
+			}
+		}
+	}
+}
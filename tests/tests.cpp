@@ -0,0 +1,1049 @@
+// Compares the optimized paths against the reference kernels.
+//
+//   aviutl-draw-tests [group...]
+//
+// Without arguments every group runs. Each group is also a ctest test.
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <numbers>
+#include <random>
+#include <string>
+#include <vector>
+#include "batch.h"
+#include "blur.h"
+#include "cpu.h"
+#include "mipmap.h"
+#include "resample.h"
+#include "threadpool.h"
+#include "shape.h"
+#include "reference.h"
+
+namespace {
+	int failures = 0;
+
+	// reports the first few failures of a check
+	struct Check {
+		const char* name;
+		int count = 0;
+
+		explicit Check(const char* name) : name(name) {}
+
+		~Check() {
+			if (count > 0) {
+				printf("  %s: %d failures\n", name, count);
+			}
+		}
+
+		template<class... Args>
+		void fail(const char* format, Args... args) {
+			if (count++ < 5) {
+				printf("  %s: ", name);
+				printf(format, args...);
+				printf("\n");
+			}
+			failures++;
+		}
+	};
+
+	int maxDiff(BGRA a, BGRA b) {
+		return std::max({ abs(a.b - b.b), abs(a.g - b.g), abs(a.r - b.r), abs(a.a - b.a) });
+	}
+
+	// Alpha within tolerance and colors within tolerance scaled up for
+	// translucent results, where the colors are divided by the alpha and
+	// an alpha that is off by one moves them further.
+	bool close(BGRA actual, BGRA expected, int tolerance) {
+		if (abs(actual.a - expected.a) > tolerance) return false;
+		const int a = std::max<int>(expected.a, 1);
+		return maxDiff(actual, expected) <= tolerance + 255 * tolerance / a;
+	}
+
+	BGRA randomPixel(std::mt19937& rng) {
+		const uint32_t x = rng();
+		return BGRA(static_cast<uint8_t>(x), static_cast<uint8_t>(x >> 8), static_cast<uint8_t>(x >> 16), static_cast<uint8_t>(x >> 24));
+	}
+
+	// a quarter each of transparent and opaque pixels, the rest random
+	std::vector<BGRA> randomPixels(std::mt19937& rng, int w, int h, int minAlpha = 0) {
+		std::vector<BGRA> v(static_cast<size_t>(w) * h);
+		for (auto& p : v) {
+			p = randomPixel(rng);
+			switch (rng() % 4) {
+			case 0: p.a = 0; break;
+			case 1: p.a = 255; break;
+			}
+			p.a = static_cast<uint8_t>(std::max<int>(p.a, minAlpha));
+		}
+		return v;
+	}
+
+	Image makeImage(const std::vector<BGRA>& pixels, int w, int h) {
+		return Image(pixels.data(), w, h);
+	}
+
+	// every composite and blend mode on all pairs of alpha values, colors
+	// random or at their limits, through the span the pipeline would pick
+	void testBlend() {
+		std::mt19937 rng(1);
+		std::vector<BGRA> dest(256 * 256), src(256 * 256);
+		for (int i = 0; i < 256 * 256; i++) {
+			dest[i] = randomPixel(rng);
+			src[i] = randomPixel(rng);
+			if (i % 7 == 0) dest[i] = BGRA(0, 255, 0, dest[i].a);
+			if (i % 11 == 0) src[i] = BGRA(255, 0, 255, src[i].a);
+			dest[i].a = static_cast<uint8_t>(i & 255);
+			src[i].a = static_cast<uint8_t>(i >> 8);
+		}
+
+		Check check("blend");
+		for (double opacity : { 1.0, 0.5, 0.0 }) {
+			const render::AlphaTable alpha(opacity);
+			for (int c = 0; c < render::compositeCount; c++) {
+				for (int b = 0; b < render::blendCount; b++) {
+					auto out = dest;
+					render::blendSpanOf(c, b, false)(out.data(), src.data(), static_cast<int>(out.size()), alpha);
+					for (size_t i = 0; i < out.size(); i++) {
+						BGRA e = reference::blendColor(composite::modes[c], reference::blendMode(b), dest[i], src[i], opacity);
+						if (memcmp(&e, &out[i], sizeof(BGRA)) != 0) {
+							check.fail("composite %d blend %d opacity %g pixel %zu: %d,%d,%d,%d expected %d,%d,%d,%d",
+								c, b, opacity, i, out[i].b, out[i].g, out[i].r, out[i].a, e.b, e.g, e.r, e.a);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	// The premultiplied canvas rounds colors to multiples of 255 / alpha,
+	// so it is compared within a tolerance that grows as the result gets
+	// more transparent, and not at all below an alpha of 16. Colors the
+	// reference wraps past 255 are saturated instead, hence the distance
+	// modulo 256. lighter wraps its alpha too and is left out.
+	bool closeWrapped(BGRA actual, BGRA expected) {
+		if (abs(actual.a - expected.a) > 1) return false;
+		auto d = [](int x, int y) {
+			const int v = abs(x - y);
+			return std::min(v, 256 - v);
+		};
+		const int tolerance = 2 + 510 / expected.a;
+		return d(actual.b, expected.b) <= tolerance && d(actual.g, expected.g) <= tolerance
+			&& d(actual.r, expected.r) <= tolerance;
+	}
+
+	void testPremultiplied() {
+		std::mt19937 rng(2);
+		const int n = 1 << 16;
+		std::vector<BGRA> dest(n), src(n);
+		for (int i = 0; i < n; i++) {
+			dest[i] = randomPixel(rng);
+			src[i] = randomPixel(rng);
+		}
+
+		Check check("premultiplied");
+		const render::AlphaTable alpha(1.0);
+		for (int c = 0; c < render::compositeCount; c++) {
+			if (composite::modes[c] == composite::lighter) continue;
+			auto out = dest;
+			for (auto& p : out) p = toPremultiplied(p);
+			render::blendSpanOf(c, 0, true)(out.data(), src.data(), n, alpha);
+			for (int i = 0; i < n; i++) {
+				const BGRA e = reference::blendColor(composite::modes[c], blend::normal, dest[i], src[i], 1.0);
+				const BGRA p = toStraight(out[i]);
+				if (e.a >= 16 && !closeWrapped(p, e)) {
+					check.fail("composite %d pixel %d: %d,%d,%d,%d expected %d,%d,%d,%d",
+						c, i, p.b, p.g, p.r, p.a, e.b, e.g, e.r, e.a);
+				}
+			}
+		}
+	}
+
+	// every composite and blend mode on all pairs of alpha values against
+	// the straight formula in floating point, premultiplied afterwards.
+	// dest is what the premultiplied pixel stands for, and the blend
+	// modes are blend::modes, so the only differences left are the
+	// roundings of the premultiplied path. Nothing wraps here, and
+	// lighter saturates like the premultiplied path does.
+	void testPremultipliedModes() {
+		std::mt19937 rng(8);
+		std::vector<BGRA> dest(256 * 256), src(256 * 256);
+		for (int i = 0; i < 256 * 256; i++) {
+			dest[i] = randomPixel(rng);
+			src[i] = randomPixel(rng);
+			dest[i].a = static_cast<uint8_t>(i & 255);
+			src[i].a = static_cast<uint8_t>(i >> 8);
+			dest[i] = toPremultiplied(dest[i]);
+		}
+
+		Check check("premultiplied modes");
+		const render::AlphaTable alpha(1.0);
+		for (int c = 0; c < render::compositeCount; c++) {
+			for (int b = 0; b < render::blendCount; b++) {
+				auto out = dest;
+				render::blendSpanOf(c, b, true)(out.data(), src.data(), static_cast<int>(out.size()), alpha);
+				for (size_t i = 0; i < out.size(); i++) {
+					const BGRA pd = toStraight(dest[i]), ps = src[i];
+					int fd, fs;
+					composite::modes[c](pd, ps, fd, fs);
+					const BGRA px = blend::modes[b](pd, ps);
+					auto channel = [&](int cd, int cs, int cx) {
+						const double mixed = (pd.a * cx + (255 - pd.a) * cs) / 255.0;
+						return std::min((pd.a * fd * cd + ps.a * fs * mixed) / (255.0 * 255.0), 255.0);
+					};
+					const double e[4] = {
+						channel(pd.b, ps.b, px.b), channel(pd.g, ps.g, px.g), channel(pd.r, ps.r, px.r),
+						std::min((pd.a * fd + ps.a * fs) / 255.0, 255.0),
+					};
+					const BGRA p = out[i];
+					const uint8_t a[4] = { p.b, p.g, p.r, p.a };
+					for (int k = 0; k < 4; k++) {
+						if (std::abs(a[k] - e[k]) > 2) {
+							check.fail("composite %d blend %d pixel %zu: %d,%d,%d,%d expected %g,%g,%g,%g",
+								c, b, i, p.b, p.g, p.r, p.a, e[0], e[1], e[2], e[3]);
+							break;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	void testYCbCr() {
+		Check check("ycbcr");
+		for (int r = 0; r < 256; r++) {
+			for (int g = 0; g < 256; g++) {
+				for (int b = 0; b < 256; b++) {
+					const BGRA c(static_cast<uint8_t>(b), static_cast<uint8_t>(g), static_cast<uint8_t>(r));
+					const YCbCr y(c);
+					const reference::YCbCr e = reference::toYCbCr(c);
+					if (y.y != e.y || y.cb != e.cb || y.cr != e.cr) {
+						check.fail("%d,%d,%d: %d,%d,%d expected %d,%d,%d", r, g, b, y.y, y.cb, y.cr, e.y, e.cb, e.cr);
+					}
+				}
+			}
+		}
+		for (int y = -300; y <= 300; y++) {
+			for (int cb = -300; cb <= 300; cb++) {
+				for (int cr = -300; cr <= 300; cr++) {
+					const BGRA c(YCbCr(static_cast<short>(y), static_cast<short>(cb), static_cast<short>(cr)));
+					const BGRA e = reference::toBGRA(reference::YCbCr{
+						static_cast<short>(y), static_cast<short>(cb), static_cast<short>(cr) });
+					if (memcmp(&c, &e, sizeof(BGRA)) != 0) {
+						check.fail("%d,%d,%d: %d,%d,%d expected %d,%d,%d", y, cb, cr, c.r, c.g, c.b, e.r, e.g, e.b);
+					}
+				}
+			}
+		}
+	}
+
+	double cubic(double x) {
+		x = std::abs(x);
+		if (x < 1) return (1.5 * x - 2.5) * x * x + 1;
+		if (x < 2) return ((-0.5 * x + 2.5) * x - 4) * x + 2;
+		return 0;
+	}
+
+	double lanczos3(double x) {
+		auto sinc = [](double v) {
+			return v == 0 ? 1 : std::sin(v * std::numbers::pi) / (v * std::numbers::pi);
+		};
+		return std::abs(x) < 3 ? sinc(x) * sinc(x / 3) : 0;
+	}
+
+	// resampling in double precision with normalized weights
+	BGRA resampleReference(const ReadOnlyImage& img, Vec2<double> p, int taps, double (*f)(double)) {
+		const int x = static_cast<int>(std::floor(p.x)) - (taps / 2 - 1);
+		const int y = static_cast<int>(std::floor(p.y)) - (taps / 2 - 1);
+		double wx[6], wy[6], sx = 0, sy = 0;
+		for (int i = 0; i < taps; i++) {
+			wx[i] = f(i - (taps / 2 - 1) - (p.x - std::floor(p.x)));
+			wy[i] = f(i - (taps / 2 - 1) - (p.y - std::floor(p.y)));
+			sx += wx[i];
+			sy += wy[i];
+		}
+		double acc[4] = {};
+		for (int j = 0; j < taps; j++) {
+			for (int i = 0; i < taps; i++) {
+				const BGRA c = img.getPixelSafe(x + i, y + j);
+				const double w = wx[i] / sx * wy[j] / sy;
+				acc[0] += w * c.b;
+				acc[1] += w * c.g;
+				acc[2] += w * c.r;
+				acc[3] += w * c.a;
+			}
+		}
+		auto channel = [](double v) {
+			return static_cast<uint8_t>(std::clamp(static_cast<int>(std::lround(v)), 0, 255));
+		};
+		return BGRA(channel(acc[0]), channel(acc[1]), channel(acc[2]), channel(acc[3]));
+	}
+
+	// every sampler on points inside, on the edge of and outside the image
+	void testSamplers() {
+		std::mt19937 rng(3);
+		const int w = 37, h = 23;
+		const auto pixels = randomPixels(rng, w, h);
+		const ReadOnlyImage img(pixels.data(), w, h);
+
+		std::vector<Vec2<int32_t>> pts;
+		for (int i = 0; i < 20000; i++) {
+			const double x = std::uniform_real_distribution<double>(-5, w + 4)(rng);
+			const double y = std::uniform_real_distribution<double>(-5, h + 4)(rng);
+			pts.push_back(interpolate::toFixed(img, Vec2<double>{ x, y }));
+		}
+		for (int y = -2; y <= h + 1; y++) {
+			for (int x = -2; x <= w + 1; x++) {
+				pts.push_back(Vec2<int32_t>{ x * interpolate::fixedOne, y * interpolate::fixedOne });
+			}
+		}
+		const int n = static_cast<int>(pts.size());
+		auto point = [&](int i) {
+			return Vec2<double>{
+				static_cast<double>(pts[i].x) / interpolate::fixedOne,
+				static_cast<double>(pts[i].y) / interpolate::fixedOne };
+		};
+
+		struct Sampler {
+			const char* name;
+			interpolate::Sampler sample;
+			bool supported;
+			std::function<BGRA(Vec2<double>)> reference;
+			int tolerance;
+		};
+		auto near = [&](Vec2<double> p) { return reference::nearestNeighbor(img, p); };
+		auto linear = [&](Vec2<double> p) { return reference::bilinear(img, p); };
+		auto bicubic = [&](Vec2<double> p) { return resampleReference(img, p, 4, cubic); };
+		auto lanczos = [&](Vec2<double> p) { return resampleReference(img, p, 6, lanczos3); };
+		const Sampler samplers[] = {
+			{ "nearestNeighborSpan", interpolate::nearestNeighborSpan, true, near, 0 },
+			{ "bilinearSpan", interpolate::bilinearSpan, true, linear, 1 },
+			{ "bilinearSpanSSE41", interpolate::bilinearSpanSSE41, cpu::hasSSE41(), linear, 1 },
+			{ "bilinearSpanAVX2", interpolate::bilinearSpanAVX2, cpu::hasAVX2(), linear, 1 },
+			{ "bicubicSpan", resample::bicubicSpan, true, bicubic, 2 },
+			{ "bicubicSpanSSE41", resample::bicubicSpanSSE41, cpu::hasSSE41(), bicubic, 2 },
+			{ "lanczos3Span", resample::lanczos3Span, true, lanczos, 2 },
+			{ "lanczos3SpanSSE41", resample::lanczos3SpanSSE41, cpu::hasSSE41(), lanczos, 2 },
+		};
+
+		for (const auto& s : samplers) {
+			if (!s.supported) continue;
+			Check check(s.name);
+			std::vector<BGRA> out(n);
+			s.sample(img, pts.data(), out.data(), n);
+			for (int i = 0; i < n; i++) {
+				const BGRA e = s.reference(point(i));
+				if (maxDiff(out[i], e) > s.tolerance) {
+					check.fail("%g,%g: %d,%d,%d,%d expected %d,%d,%d,%d", point(i).x, point(i).y,
+						out[i].b, out[i].g, out[i].r, out[i].a, e.b, e.g, e.r, e.a);
+				}
+			}
+		}
+	}
+
+	struct DrawCase {
+		int srcWidth, srcHeight;
+		int ox, oy;
+		double zoom, rotate, opacity;
+		int interpolate;
+		int blend;
+		bool opaque;
+	};
+
+	// draw() against the reference on a destination without transparent
+	// pixels, where sourceOver with a transparent sample leaves it as it
+	// is, so the reference can visit every pixel and skipping the ones
+	// outside the footprint changes nothing.
+	void compareDraw(Check& check, std::mt19937& rng, const DrawCase& c, int tolerance) {
+		const int w = 96, h = 64;
+		const auto destPixels = randomPixels(rng, w, h, 1);
+		auto srcPixels = randomPixels(rng, c.srcWidth, c.srcHeight);
+		if (c.opaque) {
+			for (auto& p : srcPixels) p.a = 255;
+		}
+		const ReadOnlyImage src(srcPixels.data(), c.srcWidth, c.srcHeight);
+
+		Image expected = makeImage(destPixels, w, h);
+		reference::draw(expected, src, composite::sourceOver, reference::blendMode(c.blend),
+			c.interpolate == 0 ? reference::nearestNeighbor : reference::bilinear,
+			c.ox, c.oy, c.zoom, c.opacity, c.rotate, true);
+
+		Image actual = makeImage(destPixels, w, h);
+		const render::Pipeline pipeline(3, c.blend, c.interpolate, c.opacity);
+		const batch::Command cmd(actual, src, pipeline, c.interpolate, c.ox, c.oy, c.zoom, c.rotate);
+		cmd.draw(actual, Rect(0, 0, w, h));
+
+		for (int y = 0; y < h; y++) {
+			for (int x = 0; x < w; x++) {
+				if (!close(actual.getPixel(x, y), expected.getPixel(x, y), tolerance)) {
+					const BGRA a = actual.getPixel(x, y), e = expected.getPixel(x, y);
+					check.fail("src %dx%d offset %d,%d zoom %g rotate %g mode %d blend %d at %d,%d: %d,%d,%d,%d expected %d,%d,%d,%d",
+						c.srcWidth, c.srcHeight, c.ox, c.oy, c.zoom, c.rotate, c.interpolate, c.blend, x, y,
+						a.b, a.g, a.r, a.a, e.b, e.g, e.r, e.a);
+				}
+			}
+		}
+	}
+
+	void testDraw() {
+		std::mt19937 rng(4);
+		{
+			// unrotated draws at zoom 1 sample exactly on texels
+			Check check("draw aligned");
+			for (int i = 0; i < 200; i++) {
+				DrawCase c{};
+				c.srcWidth = 2 * (1 + rng() % 30);
+				c.srcHeight = 2 * (1 + rng() % 20);
+				c.ox = static_cast<int>(rng() % 140) - 70;
+				c.oy = static_cast<int>(rng() % 100) - 50;
+				c.zoom = 1;
+				c.opacity = i % 3 ? 1.0 : 0.6;
+				c.interpolate = rng() % 2;
+				c.blend = rng() % render::blendCount;
+				compareDraw(check, rng, c, 0);
+			}
+		}
+		{
+			// elsewhere the fixed point samplers are within 1 of the
+			// reference; opaque sources keep the blend from amplifying that
+			Check check("draw transformed");
+			for (int i = 0; i < 200; i++) {
+				DrawCase c{};
+				c.srcWidth = 1 + rng() % 60;
+				c.srcHeight = 1 + rng() % 40;
+				c.ox = static_cast<int>(rng() % 100) - 50;
+				c.oy = static_cast<int>(rng() % 60) - 30;
+				c.zoom = std::uniform_real_distribution<double>(0.3, 3)(rng);
+				c.rotate = std::uniform_real_distribution<double>(-3.2, 3.2)(rng);
+				c.opacity = 1;
+				c.interpolate = 1;
+				c.blend = 0;
+				c.opaque = true;
+				compareDraw(check, rng, c, 2);
+			}
+		}
+		{
+			// pipelines that don't sample the source against their
+			// general spans drawing every sample
+			Check check("draw without source");
+			const int w = 96, h = 64;
+			const auto destPixels = randomPixels(rng, w, h);
+			const auto srcPixels = randomPixels(rng, 40, 30);
+			const ReadOnlyImage src(srcPixels.data(), 40, 30);
+			for (int c = 0; c < render::compositeCount; c++) {
+				for (double opacity : { 1.0, 0.0 }) {
+					const render::Pipeline pipeline(c, 4, 1, opacity);
+					if (pipeline.readsSource) continue;
+					render::Pipeline general = pipeline;
+					general.blend = render::blendSpanOf(c, 4, false);
+					general.readsSource = true;
+
+					Image expected = makeImage(destPixels, w, h), actual = makeImage(destPixels, w, h);
+					batch::Command(expected, src, general, 1, 7, -3, 1.3, 0.4).draw(expected, expected.bounds());
+					batch::Command(actual, src, pipeline, 1, 7, -3, 1.3, 0.4).draw(actual, actual.bounds());
+					if (memcmp(expected.pixels, actual.pixels, sizeof(BGRA) * w * h) != 0) {
+						check.fail("composite %d opacity %g", c, opacity);
+					}
+				}
+			}
+		}
+	}
+
+	void testPerspective() {
+		std::mt19937 rng(5);
+		Check check("perspective");
+		const int w = 96, h = 64;
+		for (int i = 0; i < 200; i++) {
+			const int sw = 1 + rng() % 60, sh = 1 + rng() % 40;
+			const auto destPixels = randomPixels(rng, w, h, 1);
+			auto srcPixels = randomPixels(rng, sw, sh);
+			for (auto& p : srcPixels) p.a = 255;
+			const ReadOnlyImage src(srcPixels.data(), sw, sh);
+
+			auto jitter = [&](double v, double range) {
+				return v + std::uniform_real_distribution<double>(-range, range)(rng);
+			};
+			const Vec2<double> xy[4] = {
+				{ jitter(10, 10), jitter(8, 8) }, { jitter(86, 10), jitter(8, 8) },
+				{ jitter(86, 10), jitter(56, 8) }, { jitter(10, 10), jitter(56, 8) },
+			};
+			const Vec2<double> uv[4] = {
+				{ 0, 0 }, { static_cast<double>(sw), 0 },
+				{ static_cast<double>(sw), static_cast<double>(sh) }, { 0, static_cast<double>(sh) },
+			};
+			const int mode = rng() % 2;
+
+			Image expected = makeImage(destPixels, w, h);
+			reference::drawPerspective(expected, src, composite::sourceOver, blend::normal,
+				mode == 0 ? reference::nearestNeighbor : reference::bilinear, xy, uv, 1.0, true);
+
+			Image actual = makeImage(destPixels, w, h);
+			Vec2<double> dst[4] = { xy[0], xy[1], xy[2], xy[3] };
+			Vec2<double> from[4] = { uv[0], uv[1], uv[2], uv[3] };
+			Mat<double> mat;
+			getPerspective(from, dst, mat);
+			const batch::Command cmd(actual, src, render::Pipeline(3, 0, mode, 1.0), mat, xy);
+			cmd.draw(actual, Rect(0, 0, w, h));
+
+			// nearest neighbour can round the other way where the projected
+			// coordinate sits on a texel boundary
+			int differing = 0;
+			for (int y = 0; y < h; y++) {
+				for (int x = 0; x < w; x++) {
+					const int d = maxDiff(actual.getPixel(x, y), expected.getPixel(x, y));
+					if (mode == 1 && d > 1) {
+						check.fail("case %d bilinear at %d,%d differs by %d", i, x, y, d);
+					}
+					differing += d > 0;
+				}
+			}
+			if (mode == 0 && differing > w * h / 200) {
+				check.fail("case %d nearest: %d pixels differ", i, differing);
+			}
+		}
+	}
+
+	// an opaque source drawn antialiased onto a transparent canvas leaves
+	// alpha summing to its area, and the same pixels where no edge crosses
+	void testAntialias() {
+		std::mt19937 rng(7);
+		const int w = 96, h = 64;
+		auto alphaSum = [&](const Image& img) {
+			double sum = 0;
+			for (int i = 0; i < w * h; i++) sum += img.pixels[i].a / 255.0;
+			return sum;
+		};
+
+		Check check("antialias");
+		for (int i = 0; i < 100; i++) {
+			const int sw = 1 + rng() % 40, sh = 1 + rng() % 30;
+			const std::vector<BGRA> srcPixels(static_cast<size_t>(sw) * sh, BGRA(255, 255, 255, 255));
+			const ReadOnlyImage src(srcPixels.data(), sw, sh);
+			const double zoom = std::uniform_real_distribution<double>(0.5, 1.5)(rng);
+			const double rotate = std::uniform_real_distribution<double>(-3.2, 3.2)(rng);
+
+			Image img;
+			img.clear(w, h);
+			batch::Command cmd(img, src, render::Pipeline(3, 0, 0, 1.0), 0, 0, 0, zoom, rotate);
+			cmd.antialias(img);
+			cmd.draw(img, cmd.bounds);
+			const double area = sw * sh * zoom * zoom;
+			if (!cmd.antialiased || std::abs(alphaSum(img) - area) > 0.01 * area + 1) {
+				check.fail("%dx%d zoom %g rotate %g: covers %g of %g", sw, sh, zoom, rotate, alphaSum(img), area);
+			}
+		}
+		for (int i = 0; i < 100; i++) {
+			const std::vector<BGRA> srcPixels(16 * 16, BGRA(255, 255, 255, 255));
+			const ReadOnlyImage src(srcPixels.data(), 16, 16);
+			auto jitter = [&](double v) {
+				return v + std::uniform_real_distribution<double>(-12, 12)(rng);
+			};
+			const Vec2<double> xy[4] = {
+				{ jitter(15), jitter(15) }, { jitter(80), jitter(15) }, { jitter(80), jitter(50) }, { jitter(15), jitter(50) },
+			};
+			Vec2<double> dst[4] = { xy[0], xy[1], xy[2], xy[3] };
+			Vec2<double> from[4] = { { 0, 0 }, { 16, 0 }, { 16, 16 }, { 0, 16 } };
+			Mat<double> mat;
+			getPerspective(from, dst, mat);
+
+			Image img;
+			img.clear(w, h);
+			batch::Command cmd(img, src, render::Pipeline(3, 0, 1, 1.0), mat, xy);
+			cmd.antialias(img);
+			cmd.draw(img, cmd.bounds);
+			double area = 0;
+			for (int k = 0; k < 4; k++) {
+				area += xy[k].x * xy[(k + 1) % 4].y - xy[(k + 1) % 4].x * xy[k].y;
+			}
+			area = std::abs(area) / 2;
+			// concave quads stay aliased
+			if (cmd.antialiased && std::abs(alphaSum(img) - area) > 0.01 * area + 1) {
+				check.fail("perspective quad %d: covers %g of %g", i, alphaSum(img), area);
+			}
+		}
+		{
+			const auto destPixels = randomPixels(rng, w, h);
+			const auto srcPixels = randomPixels(rng, 20, 30);
+			const ReadOnlyImage src(srcPixels.data(), 20, 30);
+			Image aliased = makeImage(destPixels, w, h), smooth = makeImage(destPixels, w, h);
+			batch::Command a(aliased, src, render::Pipeline(3, 4, 1, 1.0), 1, 7, -3, 1.0, 0.0);
+			batch::Command b(smooth, src, render::Pipeline(3, 4, 1, 1.0), 1, 7, -3, 1.0, 0.0);
+			b.antialias(smooth);
+			a.draw(aliased, a.bounds);
+			b.draw(smooth, b.bounds);
+			if (memcmp(aliased.pixels, smooth.pixels, sizeof(BGRA) * w * h) != 0) {
+				check.fail("draw aligned to the pixels changed");
+			}
+		}
+	}
+
+	// shapes cover the pixels they should and gradients end on their colors
+	void testShapes() {
+		const int w = 96, h = 64;
+		auto alphaSum = [&](const Image& img) {
+			double sum = 0;
+			for (int i = 0; i < w * h; i++) sum += img.pixels[i].a / 255.0;
+			return sum;
+		};
+		const render::Pipeline pipeline(3, 0, 1, 1.0);
+
+		{
+			Check check("shape rect");
+			Image img;
+			img.clear(w, h);
+			const Vec2<double> pts[4] = { { 9.5, 4.5 }, { 29.5, 4.5 }, { 29.5, 14.5 }, { 9.5, 14.5 } };
+			shape::Paint paint;
+			paint.color0 = BGRA(1, 2, 3, 255);
+			shape::draw(img, pipeline, shape::Shape::polygon(pts, 4), paint, img.bounds());
+			for (int y = 0; y < h; y++) {
+				for (int x = 0; x < w; x++) {
+					const bool inside = 10 <= x && x < 30 && 5 <= y && y < 15;
+					if ((img.getPixel(x, y).a != 0) != inside) {
+						check.fail("pixel %d,%d", x, y);
+					}
+				}
+			}
+		}
+		{
+			Check check("shape circle");
+			for (double r : { 3.0, 10.5, 25.25 }) {
+				Image img;
+				img.clear(w, h);
+				shape::Shape circle = shape::Shape::circle(Vec2<double>{ 47.3, 31.6 }, r);
+				circle.antialias();
+				shape::Paint paint;
+				paint.color0 = BGRA(255, 255, 255, 255);
+				shape::draw(img, pipeline, circle, paint, circle.bounds(img.bounds()));
+				const double area = std::numbers::pi * r * r;
+				if (std::abs(alphaSum(img) - area) > 0.01 * area + 0.5) {
+					check.fail("radius %g covers %g of %g", r, alphaSum(img), area);
+				}
+			}
+		}
+		{
+			// every convex polygon fillpolygon() takes is antialiased, not
+			// only the ones with few corners
+			Check check("shape polygon antialias");
+			for (int n : { 3, 8, 9, 16, raster::maxPolygonPoints }) {
+				Vec2<double> pts[raster::maxPolygonPoints];
+				for (int i = 0; i < n; i++) {
+					const double t = 2 * std::numbers::pi * i / n;
+					pts[i] = Vec2<double>{ 47.3 + 25 * std::cos(t), 31.6 + 25 * std::sin(t) };
+				}
+				Image img;
+				img.clear(w, h);
+				shape::Shape polygon = shape::Shape::polygon(pts, n);
+				polygon.antialias();
+				shape::Paint paint;
+				paint.color0 = BGRA(255, 255, 255, 255);
+				shape::draw(img, pipeline, polygon, paint, polygon.bounds(img.bounds()));
+				const double area = 0.5 * n * 25 * 25 * std::sin(2 * std::numbers::pi / n);
+				if (!polygon.antialiased || std::abs(alphaSum(img) - area) > 0.01 * area + 0.5) {
+					check.fail("%d corners: antialiased %d, covers %g of %g", n, polygon.antialiased, alphaSum(img), area);
+				}
+			}
+		}
+		{
+			Check check("shape gradient");
+			shape::Paint paint;
+			paint.type = shape::Paint::linear;
+			paint.color0 = BGRA(0, 100, 200, 255);
+			paint.color1 = BGRA(200, 100, 0, 55);
+			paint.p0 = Vec2<double>{ 10, 0 };
+			paint.p1 = Vec2<double>{ 30, 0 };
+			BGRA px[40];
+			paint.fill(0, 7, px, 40);
+			const BGRA mid(100, 100, 100, 155);
+			if (memcmp(&px[0], &paint.color0, sizeof(BGRA)) != 0 || memcmp(&px[10], &paint.color0, sizeof(BGRA)) != 0
+				|| memcmp(&px[20], &mid, sizeof(BGRA)) != 0
+				|| memcmp(&px[30], &paint.color1, sizeof(BGRA)) != 0 || memcmp(&px[39], &paint.color1, sizeof(BGRA)) != 0)
+			{
+				check.fail("linear gradient: %d,%d,%d,%d in the middle", px[20].b, px[20].g, px[20].r, px[20].a);
+			}
+			paint.type = shape::Paint::radial;
+			paint.radius = 8;
+			paint.fill(2, 0, px, 20);
+			if (memcmp(&px[8], &paint.color0, sizeof(BGRA)) != 0 || memcmp(&px[0], &paint.color1, sizeof(BGRA)) != 0) {
+				check.fail("radial gradient doesn't end on its colors");
+			}
+		}
+	}
+
+	// the running sums against box filters summed pixel by pixel, and
+	// transparent pixels don't darken the colors next to them
+	void testBlur() {
+		std::mt19937 rng(7);
+		const int w = 53, h = 37, radius = 4;
+		const Rect r(5, 3, 45, 33);
+		const auto pixels = randomPixels(rng, w, h);
+
+		// premultiplied, each pass over rows then columns like blur::box()
+		std::vector<double> expected(static_cast<size_t>(r.width()) * r.height() * 4);
+		for (int y = 0; y < r.height(); y++) {
+			for (int x = 0; x < r.width(); x++) {
+				const BGRA p = toPremultiplied(pixels[(r.top + y) * w + r.left + x]);
+				const uint8_t c[4] = { p.b, p.g, p.r, p.a };
+				for (int i = 0; i < 4; i++) expected[(y * r.width() + x) * 4 + i] = c[i];
+			}
+		}
+		auto boxPass = [&](int dx, int dy) {
+			const std::vector<double> in = expected;
+			for (int y = 0; y < r.height(); y++) {
+				for (int x = 0; x < r.width(); x++) {
+					for (int i = 0; i < 4; i++) {
+						double sum = 0;
+						for (int k = -radius; k <= radius; k++) {
+							const int sx = x + k * dx, sy = y + k * dy;
+							if (sx < 0 || sx >= r.width() || sy < 0 || sy >= r.height()) continue;
+							sum += in[(sy * r.width() + sx) * 4 + i];
+						}
+						expected[(y * r.width() + x) * 4 + i] = sum / (2 * radius + 1);
+					}
+				}
+			}
+		};
+		for (int pass = 0; pass < blur::passes; pass++) boxPass(1, 0);
+		for (int pass = 0; pass < blur::passes; pass++) boxPass(0, 1);
+
+		{
+			Check check("blur box");
+			ThreadPool pool(3);
+			for (ThreadPool* p : { static_cast<ThreadPool*>(nullptr), &pool }) {
+				Image img = makeImage(pixels, w, h);
+				blur::box(img, r, radius, p);
+				for (int y = 0; y < h; y++) {
+					for (int x = 0; x < w; x++) {
+						const BGRA actual = toPremultiplied(img.getPixel(x, y));
+						if (x < r.left || x >= r.right || y < r.top || y >= r.bottom) {
+							if (memcmp(&img.pixels[y * w + x], &pixels[y * w + x], sizeof(BGRA)) != 0) {
+								check.fail("pixel %d,%d outside the area changed", x, y);
+							}
+							continue;
+						}
+						const double* e = &expected[((y - r.top) * r.width() + x - r.left) * 4];
+						const uint8_t c[4] = { actual.b, actual.g, actual.r, actual.a };
+						for (int i = 0; i < 4; i++) {
+							if (std::abs(c[i] - e[i]) > 3) {
+								check.fail("pixel %d,%d channel %d: %d, expected %g", x, y, i, c[i], e[i]);
+								break;
+							}
+						}
+					}
+				}
+			}
+		}
+		{
+			Check check("blur halo");
+			Image img;
+			img.clear(w, h);
+			img.fill(Rect(20, 10, 30, 20), BGRA(40, 160, 240, 255));
+			blur::box(img, img.bounds(), 3, nullptr);
+			int visible = 0;
+			for (int i = 0; i < w * h; i++) {
+				const BGRA p = img.pixels[i];
+				if (p.a < 32) continue;
+				visible++;
+				if (!close(p, BGRA(40, 160, 240, p.a), 2)) {
+					check.fail("pixel %d,%d is %d,%d,%d at alpha %d", i % w, i / w, p.b, p.g, p.r, p.a);
+				}
+			}
+			if (visible <= 100 || img.dirty.width() <= 10) {
+				check.fail("%d visible pixels, dirty width %d", visible, img.dirty.width());
+			}
+		}
+		{
+			// radii past the size of the image are clamped to it
+			Check check("blur radius");
+			Image clamped = makeImage(pixels, w, h), huge = makeImage(pixels, w, h);
+			blur::box(clamped, clamped.bounds(), std::max(w, h), nullptr);
+			blur::box(huge, huge.bounds(), INT_MAX, nullptr);
+			if (memcmp(clamped.pixels, huge.pixels, sizeof(BGRA) * w * h) != 0) {
+				check.fail("radius INT_MAX differs from the clamped radius");
+			}
+		}
+	}
+
+	// inputs that have nothing to draw or are degenerate
+	void testEdgeCases() {
+		std::mt19937 rng(6);
+		const int w = 64, h = 48;
+		const auto destPixels = randomPixels(rng, w, h);
+		const auto srcPixels = randomPixels(rng, 16, 16);
+		const ReadOnlyImage src(srcPixels.data(), 16, 16);
+
+		auto unchanged = [&](const Image& img) {
+			return memcmp(img.pixels, destPixels.data(), sizeof(BGRA) * w * h) == 0;
+		};
+
+		{
+			Check check("off canvas");
+			const int offsets[][2] = { { 100, 0 }, { -100, 0 }, { 0, 100 }, { 0, -100 }, { 5000, -5000 } };
+			for (auto& o : offsets) {
+				for (int mode = 0; mode < render::interpolateCount; mode++) {
+					for (int c = 0; c < render::compositeCount; c++) {
+						Image img = makeImage(destPixels, w, h);
+						const batch::Command cmd(img, src, render::Pipeline(c, 0, mode, 1.0), mode, o[0], o[1], 1.0, 0.3);
+						cmd.draw(img, Rect(0, 0, w, h));
+						if (!cmd.bounds.empty() || !unchanged(img)) {
+							check.fail("offset %d,%d mode %d composite %d drew", o[0], o[1], mode, c);
+						}
+					}
+				}
+			}
+		}
+		{
+			Check check("degenerate perspective");
+			const Vec2<double> quads[][4] = {
+				{ { 20, 20 }, { 20, 20 }, { 20, 20 }, { 20, 20 } },
+				{ { 5, 5 }, { 30, 30 }, { 55, 55 }, { 10, 10 } },
+				{ { 5, 20 }, { 60, 20 }, { 60, 20 }, { 5, 20 } },
+				{ { -1e9, -1e9 }, { 1e9, -1e9 }, { 1e9, 1e9 }, { std::nan(""), 1e9 } },
+			};
+			const Vec2<double> uv[4] = { { 0, 0 }, { 16, 0 }, { 16, 16 }, { 0, 16 } };
+			for (const auto& quad : quads) {
+				Image img = makeImage(destPixels, w, h);
+				Vec2<double> dst[4] = { quad[0], quad[1], quad[2], quad[3] };
+				Vec2<double> from[4] = { uv[0], uv[1], uv[2], uv[3] };
+				Mat<double> mat;
+				getPerspective(from, dst, mat);
+				const batch::Command cmd(img, src, render::Pipeline(1, 0, 1, 1.0), mat, quad);
+				cmd.draw(img, Rect(0, 0, w, h));
+				if (!unchanged(img)) {
+					check.fail("quad %g,%g %g,%g %g,%g %g,%g drew",
+						quad[0].x, quad[0].y, quad[1].x, quad[1].y, quad[2].x, quad[2].y, quad[3].x, quad[3].y);
+				}
+			}
+		}
+		{
+			// a concave quad leaves its notch out and a bow-tie covers both
+			// of its triangles, the same pixels as an even-odd test of each
+			Check check("polygon coverage");
+			struct Case {
+				const char* name;
+				Vec2<double> quad[4];
+				int in[2];
+				int out[2];
+			};
+			const Case cases[] = {
+				{ "concave", { { 4.5, 4.5 }, { 40.5, 20.5 }, { 4.5, 36.5 }, { 16.5, 20.5 } }, { 30, 20 }, { 10, 20 } },
+				{ "bow-tie", { { 4.5, 4.5 }, { 40.5, 36.5 }, { 40.5, 4.5 }, { 4.5, 36.5 } }, { 8, 20 }, { 22, 8 } },
+			};
+			auto evenOdd = [](const Vec2<double>* q, int x, int y) {
+				const Vec2<double> p{ static_cast<double>(x), static_cast<double>(y) };
+				bool inside = false;
+				for (int i = 0; i < 4; i++) {
+					const Vec2<double> a = q[i], b = q[(i + 1) % 4];
+					if (cross(a, p, b) == 0
+						&& std::min(a.x, b.x) <= p.x && p.x <= std::max(a.x, b.x)
+						&& std::min(a.y, b.y) <= p.y && p.y <= std::max(a.y, b.y))
+					{
+						return false;
+					}
+					if ((a.y <= p.y) != (b.y <= p.y) && p.x < a.x + (p.y - a.y) * (b.x - a.x) / (b.y - a.y)) {
+						inside = !inside;
+					}
+				}
+				return inside;
+			};
+			for (const auto& c : cases) {
+				std::vector<int> covered(static_cast<size_t>(w) * h);
+				raster::scanPolygon(c.quad, 4, Rect(0, 0, w, h), [&](int y, int x0, int x1) {
+					for (int x = x0; x < x1; x++) covered[x + w * y]++;
+				});
+				for (int y = 0; y < h; y++) {
+					for (int x = 0; x < w; x++) {
+						const int expected = evenOdd(c.quad, x, y) ? 1 : 0;
+						if (covered[x + w * y] != expected) {
+							check.fail("%s at %d,%d covered %d times, expected %d", c.name, x, y, covered[x + w * y], expected);
+						}
+					}
+				}
+				if (!covered[c.in[0] + w * c.in[1]] || covered[c.out[0] + w * c.out[1]]) {
+					check.fail("%s covers %d,%d: %d, %d,%d: %d", c.name,
+						c.in[0], c.in[1], covered[c.in[0] + w * c.in[1]], c.out[0], c.out[1], covered[c.out[0] + w * c.out[1]]);
+				}
+			}
+		}
+		{
+			Check check("zero opacity");
+			std::vector<BGRA> opaque = destPixels;
+			for (auto& p : opaque) p.a = static_cast<uint8_t>(std::max<int>(p.a, 1));
+			Image dest = makeImage(opaque, w, h);
+			const batch::Command cmd(dest, src, render::Pipeline(3, 0, 1, 0.0), 1, 0, 0, 1.5, 0.2);
+			cmd.draw(dest, Rect(0, 0, w, h));
+			if (memcmp(dest.pixels, opaque.data(), sizeof(BGRA) * w * h) != 0) {
+				check.fail("sourceOver at opacity 0 changed the destination");
+			}
+		}
+		{
+			// pixels outside the dirty rect stay transparent black, so
+			// clearing and reading back only the dirty rect is enough
+			Check check("dirty");
+			Image img;
+			img.clear(w, h);
+			const batch::Command cmd(img, src, render::Pipeline(3, 0, 1, 1.0), 1, -20, 10, 0.7, 0.5);
+			img.markDirty(cmd.bounds);
+			img.premultiply();
+			cmd.draw(img, cmd.bounds);
+			Image straight = img;
+			straight.unpremultiply();
+			const Rect d = img.dirty;
+			for (int y = 0; y < h; y++) {
+				for (int x = 0; x < w; x++) {
+					const BGRA p = straight.getPixel(x, y);
+					const bool inside = d.left <= x && x < d.right && d.top <= y && y < d.bottom;
+					if (!inside && (p.b | p.g | p.r | p.a)) {
+						check.fail("pixel %d,%d outside the dirty rect was drawn", x, y);
+					}
+				}
+			}
+			Image part;
+			img.copyRegion(Rect(-3, 5, 40, 30), part);
+			for (int y = 0; y < part.height; y++) {
+				for (int x = 0; x < part.width; x++) {
+					const int sx = x - 3, sy = y + 5;
+					const BGRA e = sx < 0 ? BGRA(0, 0, 0, 0) : straight.getPixel(sx, sy);
+					if (memcmp(&e, &part.pixels[x + part.width * y], sizeof(BGRA)) != 0) {
+						check.fail("region pixel %d,%d differs from the image", x, y);
+					}
+				}
+			}
+			img.clear();
+			if (!img.dirty.empty() || std::any_of(img.pixels, img.pixels + w * h, [](BGRA p) { return p.a != 0; })) {
+				check.fail("clear() left pixels behind");
+			}
+		}
+		{
+			Check check("fill");
+			Image img;
+			img.clear(w, h);
+			const BGRA color(10, 20, 30, 40), transparent(0, 0, 0, 0);
+			img.fill(Rect(-5, 7, 30, 20), color);
+			img.fill(Rect(0, 30, w, 40), color);
+			for (int y = 0; y < h; y++) {
+				for (int x = 0; x < w; x++) {
+					const bool inside = (x < 30 && 7 <= y && y < 20) || (30 <= y && y < 40);
+					const BGRA p = img.getPixel(x, y);
+					if (memcmp(&p, inside ? &color : &transparent, sizeof(BGRA)) != 0) {
+						check.fail("pixel %d,%d is %d,%d,%d,%d", x, y, p.b, p.g, p.r, p.a);
+					}
+				}
+			}
+			const Rect d = img.dirty;
+			if (d.left != 0 || d.top != 7 || d.right != w || d.bottom != 40) {
+				check.fail("dirty rect %d,%d,%d,%d", d.left, d.top, d.right, d.bottom);
+			}
+		}
+		{
+			// tiles and bands replay a command exactly like one full draw
+			Check check("tiles");
+			std::vector<batch::Command> commands;
+			Image full = makeImage(destPixels, w, h);
+			for (int i = 0; i < 20; i++) {
+				const int mode = rng() % render::interpolateCount;
+				const double zoom = std::uniform_real_distribution<double>(0.2, 3)(rng);
+				commands.emplace_back(full, src, render::Pipeline(rng() % 13, rng() % 28, mode, 0.8), mode,
+					static_cast<int>(rng() % 60) - 30, static_cast<int>(rng() % 40) - 20, zoom,
+					i % 4 ? std::uniform_real_distribution<double>(-3, 3)(rng) : 0.0,
+					[&] { return std::make_shared<const mipmap::Pyramid>(src); });
+			}
+			for (const auto& cmd : commands) {
+				cmd.draw(full, Rect(0, 0, w, h));
+			}
+			Image tiled = makeImage(destPixels, w, h);
+			const batch::TileBins bins(commands, w, h);
+			for (int t = bins.count() - 1; t >= 0; t--) {
+				bins.draw(tiled, commands, t);
+			}
+			if (memcmp(full.pixels, tiled.pixels, sizeof(BGRA) * w * h) != 0) {
+				check.fail("tiled replay differs from drawing in order");
+			}
+		}
+		{
+			// a reused buffer gets a new pyramid when it holds another image,
+			// or after invalidate() when only a few pixels changed
+			Check check("mipmap cache");
+			auto pixels = randomPixels(rng, 300, 200);
+			const ReadOnlyImage img(pixels.data(), 300, 200);
+			const auto first = mipmap::cached(img);
+			if (mipmap::cached(img) != first) {
+				check.fail("unchanged buffer rebuilt");
+			}
+			const auto other = randomPixels(rng, 300, 200);
+			std::copy(other.begin(), other.end(), pixels.begin());
+			const auto replaced = mipmap::cached(img);
+			if (replaced == first) {
+				check.fail("another image in the buffer reused the pyramid");
+			}
+			pixels[12345].g ^= 1;
+			mipmap::invalidate(img.data);
+			if (mipmap::cached(img) == replaced) {
+				check.fail("pixel changed and invalidated but the pyramid was reused");
+			}
+			mipmap::clearCache();
+		}
+		{
+			// draws that cover no pixel don't build a pyramid
+			Check check("mipmap on demand");
+			struct Draw {
+				int ox;
+				double zoom;
+				bool builds;
+			};
+			const Draw draws[] = { { 0, 0.5, true }, { 5000, 0.5, false }, { 0, 0.0, false }, { 0, 2.0, false } };
+			for (const auto& d : draws) {
+				Image img = makeImage(destPixels, w, h);
+				bool built = false;
+				const batch::Command cmd(img, src, render::Pipeline(3, 0, interpolate::mipmapMode, 1.0),
+					interpolate::mipmapMode, d.ox, 0, d.zoom, 0.0, [&] {
+						built = true;
+						return std::make_shared<const mipmap::Pyramid>(src);
+					});
+				if (built != d.builds) {
+					check.fail("offset %d zoom %g %s a pyramid", d.ox, d.zoom, built ? "built" : "didn't build");
+				}
+			}
+		}
+	}
+
+	struct Group {
+		const char* name;
+		void (*run)();
+	};
+
+	const Group groups[] = {
+		{ "blend", testBlend },
+		{ "premultiplied", testPremultiplied },
+		{ "premultipliedmodes", testPremultipliedModes },
+		{ "ycbcr", testYCbCr },
+		{ "samplers", testSamplers },
+		{ "draw", testDraw },
+		{ "perspective", testPerspective },
+		{ "antialias", testAntialias },
+		{ "shapes", testShapes },
+		{ "blur", testBlur },
+		{ "edge", testEdgeCases },
+	};
+}
+
+int main(int argc, char** argv) {
+	std::vector<std::string> selected(argv + 1, argv + argc);
+	for (const auto& name : selected) {
+		if (std::none_of(std::begin(groups), std::end(groups), [&](const Group& g) { return name == g.name; })) {
+			fprintf(stderr, "unknown group %s\n", name.c_str());
+			return 2;
+		}
+	}
+	for (const auto& g : groups) {
+		if (!selected.empty() && std::find(selected.begin(), selected.end(), g.name) == selected.end()) continue;
+		printf("%s\n", g.name);
+		g.run();
+	}
+	printf(failures ? "%d failures\n" : "ok\n", failures);
+	return failures ? 1 : 0;
+}